@@ -8,326 +8,150 @@
 #include "Export.hpp"
 #include "util/Util.hpp"
 #include "csv.h"
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
-#include <stdlib.h>
-#include <inttypes.h>
 #include <time.h>
+#include <unistd.h>
 #include <string>
-#include <math.h>
 #include <boost/algorithm/string.hpp>
 
 namespace abcd {
 
 #define MAX_DATE_TIME_SIZE 20
-#define MAX_AMOUNT_STRING_SIZE 20 // 21 million + 8 decimals + padding. ~20 digits
 
-/* Maxium size of CSV record and fields in characters */
-#define ABC_CSV_MAX_REC_SZ  16384
-#define ABC_CSV_MAX_FLD_SZ  4096
-
-#define ABC_CSV_DFLT_DELIMITER "|"
 #define ABC_CSV_ALT1_DELIMITER ","
 
 #define ABC_CSV_REC_TERM_NAME "VER"
 #define ABC_CSV_REC_TERM_VALUE "1"
 
+/**
+ * Formats a satoshi amount using the core's usual rules.
+ */
+static Status
+exportAmount(std::string &result, int64_t amount, unsigned decimalPlaces,
+             bool addSign)
+{
+    AutoString formatted;
+    ABC_CHECK_OLD(ABC_FormatAmount(amount, &formatted.get(),
+                                   decimalPlaces, addSign, &error));
+    result = formatted.get();
+    return Status();
+}
 
-#define ABC_CSV(type)    struct { \
-                                      type ov[ABC_CSV_MAX_FLD_SZ]; \
-                                      type qv[ABC_CSV_MAX_FLD_SZ]; \
-                                      size_t os; \
-                                      size_t qs; \
-                                }
-
-#define ABC_CSV_INIT(fld, src)  { \
-                                  strncpy((fld).ov, src, ABC_CSV_MAX_FLD_SZ); \
-                                  memset((fld).qv, 0, sizeof((fld).qv)); \
-                                  (fld).os = strlen(src); \
-                                  (fld).qs = 0; \
-                                }
-
-#define ABC_CSV_INIT2(fld, src, type) {\
-                                        char _tmpXform[ABC_CSV_MAX_FLD_SZ]; \
-                                        snprintf(_tmpXform,ABC_CSV_MAX_FLD_SZ,"%" type, src); \
-                                        ABC_CSV_INIT(fld, _tmpXform); \
-                                      }
-
-#define ABC_CSV_FMT(v, d)       { \
-                                  size_t _sz = 0; \
-                                  _sz = csv_write(v.qv, sizeof(v.qv), v.ov, v.os); \
-                                  v.qs = _sz; \
-                                  ABC_STR_NEW(d, v.qs+1+1); \
-                                  snprintf(d, v.qs+1+1,"%s%s", v.qv, ABC_CSV_ALT1_DELIMITER); \
-                                }
-
+static Status
+exportTime(std::string &result, time_t t, const char *format)
+{
+    char buff[MAX_DATE_TIME_SIZE];
+    struct tm *tmptr = localtime(&t);
+    if (!strftime(buff, sizeof buff, format, tmptr))
+        return ABC_ERROR(ABC_CC_Error, "Could not format date");
 
-typedef ABC_CSV(char) tABC_CSV;
+    result = buff;
+    return Status();
+}
 
-tABC_CC ABC_ExportGenerateHeader(char **szCsvRec, tABC_Error *pError,
-                                 std::string currency)
+/**
+ * Quotes a CSV field and appends it to a record, along with its delimiter.
+ */
+static void
+csvAppend(std::string &record, const std::string &field)
 {
-    tABC_CC cc = ABC_CC_Ok;
-    char **out = szCsvRec;
-
-    /* header */
-    const char *szDateCreation = "DATE";
-    const char *szTimeCreation = "TIME";
-    const char *szName = "PAYEE_PAYER_NAME"; /* payee or payer */
-    const char *szAmtBTC = "AMT_BTC";
-    const char *szCurrency = currency.c_str();
-    const char *szCategory = "CATEGORY";
-    const char *szNotes = "NOTES";
-    const char *szAmtAirbitzBTC = "AMT_BTC_FEES_AB";
-    const char *szAmtFeesMinersBTC = "AMT_BTC_FEES_MINERS";
-    const char *szInputAddresses = "IN_ADDRESSES";
-    const char *szOutputAddresses = "OUT_ADDRESSES";
-    const char *szCsvTxid = "TXID";
-
-    ABC_CHECK_NULL(szCsvRec);
-
-    /* Allocated enough space for the header descriptions */
-    ABC_STR_NEW(*szCsvRec, ABC_CSV_MAX_REC_SZ);
-
-    /* build the entire record */
-    snprintf(*out, ABC_CSV_MAX_FLD_SZ,
-             "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
-             szDateCreation,
-             szTimeCreation,
-             szName,
-             szAmtBTC,
-             szCurrency,
-             szCategory,
-             szNotes,
-             szAmtAirbitzBTC,
-             szAmtFeesMinersBTC,
-             szInputAddresses,
-             szOutputAddresses,
-             szCsvTxid,
-             ABC_CSV_REC_TERM_NAME);
-exit:
-    return cc;
+    const auto size = csv_write(nullptr, 0, field.data(), field.size());
+    const auto start = record.size();
+    record.resize(start + size);
+    csv_write(&record[start], size, field.data(), field.size());
+    record += ABC_CSV_ALT1_DELIMITER;
 }
 
-tABC_CC ABC_ExportGetAddresses(tABC_TxInfo *pData,
-                               char **szAddresses,
-                               bool bInputs,
-                               tABC_Error *pError)
+/**
+ * Lists the addresses and amounts on one side of a transaction.
+ */
+static Status
+csvAddresses(std::string &result, const tABC_TxInfo &tx, bool inputs)
 {
-    tABC_CC cc = ABC_CC_Ok;
-
-    unsigned i;
-    int numAddr = 0;
-    char *szAmount = NULL;
-
-    // Clear string if allocated
-    if (*szAddresses != NULL)
+    std::string out;
+    for (unsigned i = 0; i < tx.countOutputs; i++)
     {
-        strcpy(*szAddresses, "");
+        const auto &io = *tx.aOutputs[i];
+        if (io.input != inputs)
+            continue;
+
+        std::string amount;
+        ABC_CHECK(exportAmount(amount, io.value,
+                               ABC_BITCOIN_DECIMAL_PLACES, false));
+        if (!out.empty())
+            out += " ";
+        out += std::string(io.szAddress) + ":" + amount;
     }
 
-    for (i = 0; i < pData->countOutputs; i++)
-    {
-        bool doCopy = false;
-        if (pData->aOutputs[i]->input)
-        {
-            if (bInputs)
-            {
-                // Found an input and want only inputs
-                doCopy = true;
-            }
-        }
-        else if (!bInputs)
-        {
-            // Found an output and want only outputs
-            doCopy = true;
-        }
-
-        if (doCopy)
-        {
-            int lengthNeeded;
-
-            ABC_STR_NEW(szAmount, MAX_AMOUNT_STRING_SIZE)
-
-            ABC_CHECK_RET(ABC_FormatAmount(pData->aOutputs[i]->value, &szAmount,
-                                           ABC_BITCOIN_DECIMAL_PLACES, false, pError));
-
-            lengthNeeded = ABC_STRLEN(*szAddresses) + ABC_STRLEN(
-                               pData->aOutputs[i]->szAddress) + ABC_STRLEN(szAmount) + 3;
-
-            if (lengthNeeded > ABC_CSV_MAX_FLD_SZ) break;
-
-            ABC_ARRAY_RESIZE(*szAddresses, lengthNeeded, char);
-
-            if (numAddr == 0)
-            {
-                snprintf(*szAddresses, lengthNeeded, "%s:%s", pData->aOutputs[i]->szAddress,
-                         szAmount);
-            }
-            else
-            {
-                snprintf(*szAddresses, lengthNeeded, "%s %s:%s", *szAddresses,
-                         pData->aOutputs[i]->szAddress, szAmount);
-            }
-            numAddr++;
-        }
-    }
-
-exit:
-    ABC_FREE(szAmount);
-    return cc;
+    result = out;
+    return Status();
 }
 
-tABC_CC ABC_ExportGenerateRecord(tABC_TxInfo *data, char **szCsvRec,
-                                 tABC_Error *pError)
+static Status
+csvHeader(std::string &result, const std::string &currency)
 {
-    tABC_CC cc = ABC_CC_Ok;
-
-    tABC_TxInfo *pData = data;
-    char **out = szCsvRec;
-
-    /* header */
-    char *szDateCreation;
-    char *szTimeCreation;
-    char *szName; /* payee or payer */
-    char *szAmtBTC;
-    char *szCurrency;
-    char *szCategory;
-    char *szNotes;
-    char *szAmtAirbitzBTC;
-    char *szAmtFeesMinersBTC;
-    char *szInputAddresses;
-    char *szOutputAddresses;
-    char *szCsvTxid;
+    result = "DATE,"
+             "TIME,"
+             "PAYEE_PAYER_NAME," // payee or payer
+             "AMT_BTC," +
+             currency + ","
+             "CATEGORY,"
+             "NOTES,"
+             "AMT_BTC_FEES_AB,"
+             "AMT_BTC_FEES_MINERS,"
+             "IN_ADDRESSES,"
+             "OUT_ADDRESSES,"
+             "TXID,"
+             ABC_CSV_REC_TERM_NAME "\n";
+    return Status();
+}
 
-    char buff[MAX_DATE_TIME_SIZE];
-    char *pFormatted = NULL;
+static Status
+csvRecord(std::string &result, const tABC_TxInfo &tx)
+{
+    const auto &details = *tx.pDetails;
+    std::string field;
+    std::string out;
 
-    time_t t = (time_t) pData->timeCreation;
-    struct tm *tmptr = localtime(&t);
+    ABC_CHECK(exportTime(field, tx.timeCreation, "%Y-%m-%d"));
+    csvAppend(out, field);
+    ABC_CHECK(exportTime(field, tx.timeCreation, "%H:%M"));
+    csvAppend(out, field);
 
-    tABC_CSV tmpCsvVar;
+    csvAppend(out, details.szName);
 
-    ABC_CHECK_NULL(data);
+    ABC_CHECK(exportAmount(field, details.amountSatoshi,
+                           ABC_BITCOIN_DECIMAL_PLACES, true));
+    csvAppend(out, field);
 
-    if (!strftime(buff, sizeof buff, "%Y-%m-%d", tmptr))
-    {
-        cc = ABC_CC_Error;
-        goto exit;
-    }
-    ABC_CSV_INIT(tmpCsvVar, buff);
-    ABC_CSV_FMT(tmpCsvVar, szDateCreation);
+    char currency[32];
+    snprintf(currency, sizeof(currency), "%0.2f", details.amountCurrency);
+    csvAppend(out, currency);
 
-    if (!strftime(buff, sizeof buff, "%H:%M", tmptr))
-    {
-        cc = ABC_CC_Error;
-        goto exit;
-    }
-    ABC_CSV_INIT(tmpCsvVar, buff);
-    ABC_CSV_FMT(tmpCsvVar, szTimeCreation);
-
-    ABC_CSV_INIT(tmpCsvVar, pData->pDetails->szName);
-    ABC_CSV_FMT(tmpCsvVar, szName);
-
-    ABC_CHECK_RET(ABC_FormatAmount(pData->pDetails->amountSatoshi,&pFormatted,
-                                   ABC_BITCOIN_DECIMAL_PLACES, true, pError));
-    ABC_CSV_INIT(tmpCsvVar, pFormatted);
-    ABC_CSV_FMT(tmpCsvVar, szAmtBTC);
-
-    ABC_CSV_INIT2(tmpCsvVar, pData->pDetails->amountCurrency, "0.2f");
-    ABC_CSV_FMT(tmpCsvVar, szCurrency);
-
-    ABC_CSV_INIT(tmpCsvVar, pData->pDetails->szCategory);
-    ABC_CSV_FMT(tmpCsvVar, szCategory);
-
-    ABC_CSV_INIT(tmpCsvVar, pData->pDetails->szNotes);
-    ABC_CSV_FMT(tmpCsvVar, szNotes);
-
-    ABC_CHECK_RET(ABC_FormatAmount(pData->pDetails->amountFeesAirbitzSatoshi,
-                                   &pFormatted, ABC_BITCOIN_DECIMAL_PLACES, true, pError));
-    ABC_CSV_INIT(tmpCsvVar, pFormatted);
-    ABC_CSV_FMT(tmpCsvVar, szAmtAirbitzBTC);
-
-    ABC_CHECK_RET(ABC_FormatAmount(pData->pDetails->amountFeesMinersSatoshi,
-                                   &pFormatted, ABC_BITCOIN_DECIMAL_PLACES, true, pError));
-    ABC_CSV_INIT(tmpCsvVar, pFormatted);
-    ABC_CSV_FMT(tmpCsvVar, szAmtFeesMinersBTC);
-
-    ABC_CHECK_RET(ABC_ExportGetAddresses(pData, &pFormatted, true, pError));
-    ABC_CSV_INIT(tmpCsvVar, pFormatted);
-    ABC_CSV_FMT(tmpCsvVar, szInputAddresses);
-
-    ABC_CHECK_RET(ABC_ExportGetAddresses(pData, &pFormatted, false, pError));
-    ABC_CSV_INIT(tmpCsvVar, pFormatted);
-    ABC_CSV_FMT(tmpCsvVar, szOutputAddresses);
-
-    ABC_CSV_INIT(tmpCsvVar, data->szID);
-    ABC_CSV_FMT(tmpCsvVar, szCsvTxid);
-
-    /* Allocated enough space for one CSV REC - Determined by adding all field when quoted */
-    ABC_STR_NEW(*szCsvRec, ABC_CSV_MAX_REC_SZ+1);
-
-    /* build the entire record */
-    snprintf(*out, ABC_CSV_MAX_FLD_SZ,
-             "%s%s%s%s%s%s%s%s%s%s%s%s%s\n",
-             szDateCreation,
-             szTimeCreation,
-             szName,
-             szAmtBTC,
-             szCurrency,
-             szCategory,
-             szNotes,
-             szAmtAirbitzBTC,
-             szAmtFeesMinersBTC,
-             szInputAddresses,
-             szOutputAddresses,
-             szCsvTxid,
-             ABC_CSV_REC_TERM_VALUE);
-
-    ABC_FREE(szTimeCreation);
-    ABC_FREE(szDateCreation);
-    ABC_FREE(szName);
-    ABC_FREE(szAmtBTC);
-    ABC_FREE(szCurrency);
-    ABC_FREE(szCategory);
-    ABC_FREE(szNotes);
-    ABC_FREE(szAmtAirbitzBTC);
-    ABC_FREE(szAmtFeesMinersBTC);
-    ABC_FREE(szCsvTxid);
-    ABC_FREE(pFormatted);
-
-
-exit:
-    return cc;
-}
+    csvAppend(out, details.szCategory);
+    csvAppend(out, details.szNotes);
 
-tABC_CC ABC_ExportFormatCsv(tABC_TxInfo **pTransactions,
-                            unsigned int iTransactionCount,
-                            char **szCsvData,
-                            tABC_Error *pError,
-                            std::string currency)
-{
-    tABC_CC cc = ABC_CC_Ok;
+    ABC_CHECK(exportAmount(field, details.amountFeesAirbitzSatoshi,
+                           ABC_BITCOIN_DECIMAL_PLACES, true));
+    csvAppend(out, field);
+    ABC_CHECK(exportAmount(field, details.amountFeesMinersSatoshi,
+                           ABC_BITCOIN_DECIMAL_PLACES, true));
+    csvAppend(out, field);
 
-    std::string out;
-    {
-        AutoString szCurrRec;
-        ABC_CHECK_RET(ABC_ExportGenerateHeader(&szCurrRec.get(), pError, currency));
-        out += szCurrRec;
-    }
+    ABC_CHECK(csvAddresses(field, tx, true));
+    csvAppend(out, field);
+    ABC_CHECK(csvAddresses(field, tx, false));
+    csvAppend(out, field);
 
-    for (unsigned i=0; i < iTransactionCount; i++)
-    {
-        AutoString szCurrRec;
-        ABC_CHECK_RET(ABC_ExportGenerateRecord(pTransactions[i], &szCurrRec.get(),
-                                               pError));
-        out += szCurrRec;
-    }
+    csvAppend(out, tx.szID);
 
-    *szCsvData = stringCopy(out);
+    out += ABC_CSV_REC_TERM_VALUE "\n";
 
-exit:
-    return cc;
+    result = out;
+    return Status();
 }
 
 Status escapeOFXString(std::string &string)
@@ -388,24 +212,21 @@ exportQBOGenerateHeader(std::string &result, std::string date_today,
 #define MAX_MEMO_SIZE 253
 
 static Status
-exportQBOGenerateRecord(std::string &result, tABC_TxInfo *data,
+exportQBOGenerateRecord(std::string &result, const tABC_TxInfo *data,
                         std::string currency)
 {
     tABC_TxDetails *pDetails = data->pDetails;
 
-    AutoString amountFormatted;
-    ABC_CHECK_OLD(ABC_FormatAmount(pDetails->amountSatoshi,
-                                   &amountFormatted.get(),
-                                   ABC_BITCOIN_DECIMAL_PLACES - (ABC_DENOMINATION_UBTC * 3),
-                                   true, &error));
+    std::string amount;
+    ABC_CHECK(exportAmount(amount, pDetails->amountSatoshi,
+                           ABC_BITCOIN_DECIMAL_PLACES - (ABC_DENOMINATION_UBTC * 3),
+                           true));
 
-    char buff[MAX_DATE_TIME_SIZE];
     char buffMemo[MAX_MEMO_SIZE];
     char buffExRate[10];
     std::string transaction;
     std::string trtype;
     std::string date_time;
-    std::string amount(amountFormatted.get());
     std::string txid(data->szID);
     std::string payee(pDetails->szName);
     std::string trname;
@@ -418,12 +239,7 @@ exportQBOGenerateRecord(std::string &result, tABC_TxInfo *data,
         trtype = "DEBIT";
 
     // Transaction date/time
-    time_t t = (time_t) data->timeCreation;
-    struct tm *tmptr = localtime(&t);
-
-    if (!strftime(buff, sizeof buff, "%Y%m%d%H%M%S.000", tmptr))
-        return ABC_ERROR(ABC_CC_Error, "Could not format date");
-    date_time = buff;
+    ABC_CHECK(exportTime(date_time, data->timeCreation, "%Y%m%d%H%M%S.000"));
 
     // Payee name
     escapeOFXString(payee);
@@ -468,50 +284,118 @@ exportQBOGenerateRecord(std::string &result, tABC_TxInfo *data,
     return Status();
 }
 
-Status
-exportFormatQBO(std::string &result, tABC_TxInfo **pTransactions,
-                unsigned int iTransactionCount, std::string currency)
+static Status
+exportQBOGenerateFooter(std::string &result, std::string date_today)
 {
-    time_t rawtime = time(nullptr);
-    tm *timeinfo = localtime(&rawtime);
+    result = "</BANKTRANLIST>\n"
+             "<LEDGERBAL>\n"
+             "<BALAMT>0.00\n"
+             "<DTASOF>" + date_today + "\n"
+             "</LEDGERBAL>\n"
+             "<AVAILBAL>\n"
+             "<BALAMT>0.00\n"
+             "<DTASOF>" +  date_today + "\n"
+             "</AVAILBAL>\n"
+             "</STMTRS>\n"
+             "</STMTTRNRS>\n"
+             "</BANKMSGSRSV1>\n"
+             "</OFX>\n";
 
-    char buffer[80];
-    strftime(buffer, 80, "%Y%m%d%H%M%S.000", timeinfo);
-    std::string date_today = buffer;
+    return Status();
+}
 
+ExportWriter::ExportWriter(ExportFormat format, const ExportSink &sink):
+    format_(format),
+    sink_(sink)
+{
+}
+
+Status
+ExportWriter::begin(const std::string &currency)
+{
+    currency_ = currency;
+    return Status();
+}
+
+Status
+ExportWriter::write(const tABC_TxInfo &tx, const std::string &currency)
+{
     std::string out;
+
+    // The header goes out with the first transaction:
+    if (!count_)
     {
-        std::string header;
-        ABC_CHECK(exportQBOGenerateHeader(header, date_today, currency));
-        out += header;
+        switch (format_)
+        {
+        case ExportFormat::csv:
+            ABC_CHECK(csvHeader(out, currency_));
+            break;
+
+        case ExportFormat::qbo:
+            ABC_CHECK(exportTime(date_, time(nullptr), "%Y%m%d%H%M%S.000"));
+            ABC_CHECK(exportQBOGenerateHeader(out, date_, currency_));
+            break;
+        }
     }
 
-    for (unsigned i = 0; i < iTransactionCount; i++)
+    std::string record;
+    switch (format_)
     {
-        std::string transactions;
-        ABC_CHECK(exportQBOGenerateRecord(transactions, pTransactions[i], currency));
-        out += transactions;
-    }
+    case ExportFormat::csv:
+        ABC_CHECK(csvRecord(record, tx));
+        break;
 
-    // Write footer
-    out += "</BANKTRANLIST>\n"
-           "<LEDGERBAL>\n"
-           "<BALAMT>0.00\n"
-           "<DTASOF>" + date_today + "\n"
-           "</LEDGERBAL>\n"
-           "<AVAILBAL>\n"
-           "<BALAMT>0.00\n"
-           "<DTASOF>" +  date_today + "\n"
-           "</AVAILBAL>\n"
-           "</STMTRS>\n"
-           "</STMTTRNRS>\n"
-           "</BANKMSGSRSV1>\n"
-           "</OFX>\n";
+    case ExportFormat::qbo:
+        ABC_CHECK(exportQBOGenerateRecord(record, &tx, currency));
+        break;
+    }
 
-    result = out;
+    ABC_CHECK(sink_(out + record));
+    ++count_;
     return Status();
 }
 
+Status
+ExportWriter::end()
+{
+    std::string out;
+    switch (format_)
+    {
+    case ExportFormat::csv:
+        break;
+
+    case ExportFormat::qbo:
+        ABC_CHECK(exportQBOGenerateFooter(out, date_));
+        break;
+    }
 
+    ABC_CHECK(sink_(out));
+    return Status();
+}
+
+ExportSink
+exportSinkFd(int fd)
+{
+    return [fd](const std::string &data) -> Status
+    {
+        const char *p = data.data();
+        size_t left = data.size();
+        while (left)
+        {
+            const auto written = ::write(fd, p, left);
+            if (written < 0)
+            {
+                if (EINTR == errno)
+                    continue;
+                return ABC_ERROR(ABC_CC_FileWriteError,
+                                 std::string("Cannot write export: ") +
+                                 strerror(errno));
+            }
+            p += written;
+            left -= written;
+        }
+        return Status();
+    };
+}
 
 } // namespace abcd
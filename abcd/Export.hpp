@@ -13,18 +13,71 @@
 #define ABC_Export_h
 
 #include "util/Status.hpp"
+#include <functional>
 
 namespace abcd {
 
-tABC_CC ABC_ExportFormatCsv(tABC_TxInfo **pTransactions,
-                            unsigned int iTransactionCount,
-                            char **szCsvData,
-                            tABC_Error *pError,
-                            std::string currency);
+enum class ExportFormat
+{
+    csv,
+    qbo
+};
 
-Status
-exportFormatQBO(std::string &result, tABC_TxInfo **pTransactions,
-                unsigned int iTransactionCount, std::string currency);
+/**
+ * Receives the export output one piece at a time.
+ */
+typedef std::function<Status (const std::string &data)> ExportSink;
+
+/**
+ * Writes transactions out in one of the export formats as they arrive,
+ * so the finished export never has to sit in memory.
+ * Transactions from several wallets can go into the same export.
+ */
+class ExportWriter
+{
+public:
+    ExportWriter(ExportFormat format, const ExportSink &sink);
+
+    /**
+     * Starts the export. The file header waits for the first transaction,
+     * so an export with nothing in it leaves nothing behind.
+     * @param currency The currency code for the fiat amount column.
+     */
+    Status
+    begin(const std::string &currency);
+
+    /**
+     * Writes one transaction.
+     * @param currency The currency code for the transaction's wallet.
+     */
+    Status
+    write(const tABC_TxInfo &tx, const std::string &currency);
+
+    /**
+     * Writes the file footer.
+     */
+    Status
+    end();
+
+    /**
+     * The number of transactions written so far.
+     */
+    size_t
+    count() const { return count_; }
+
+private:
+    const ExportFormat format_;
+    const ExportSink sink_;
+    std::string currency_;
+    std::string date_;
+    size_t count_ = 0;
+};
+
+/**
+ * Sends export output to an open file descriptor.
+ */
+ExportSink
+exportSinkFd(int fd);
 
 } // namespace abcd
 
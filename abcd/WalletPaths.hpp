@@ -31,6 +31,8 @@ public:
     std::string currencyPath() const { return dir_ + "sync/Currency.json"; }
     std::string namePath() const { return dir_ + "sync/WalletName.json"; }
     std::string cachePath() const { return dir_ + "Cache.json"; }
+    std::string txCachePath() const { return dir_ + "TxCache.bin"; }
+    std::string txIndexPath() const { return dir_ + "TxIndex.json"; }
     std::string cachePathOld() const { return dir_ + "watcher.ser"; }
 
 private:
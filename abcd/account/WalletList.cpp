@@ -10,8 +10,6 @@
 #include "../json/JsonObject.hpp"
 #include "../login/Login.hpp"
 #include "../util/FileIO.hpp"
-#include <dirent.h>
-#include <string.h>
 
 namespace abcd {
 
@@ -40,30 +38,29 @@ WalletList::load()
                                      account_.dataKey()));
 
     // Step 2: scan the directory for new wallets:
-    DIR *dir = opendir(dir_.c_str());
-    if (!dir)
-        return Status(); // No directory, so no wallets
-
-    struct dirent *de;
-    while (nullptr != (de = readdir(dir)))
+    std::vector<JsonFile> loaded;
+    for (const auto &name: fileListJson(dir_))
     {
-        if (!fileIsJson(de->d_name))
-            continue;
-
         // TODO: Be sure the file has been synced!
 
         // Skip stuff we already have:
-        std::string id(de->d_name, de->d_name + strlen(de->d_name) - 5);
-        if (wallets_.end() != wallets_.find(id))
-            continue;
-
-        // Try to load the wallet:
-        JsonPtr json;
-        if (json.load(dir_ + de->d_name, account_.dataKey()))
-            wallets_[id] = std::move(json);
+        std::string id(name, 0, name.size() - 5);
+        if (wallets_.end() == wallets_.find(id))
+            loaded.push_back(JsonFile{dir_ + name});
+    }
+
+    // Try to load the wallets:
+    jsonLoadFiles(loaded, account_.dataKey());
+    for (auto &file: loaded)
+    {
+        if (file.status)
+        {
+            std::string id(file.path, dir_.size(),
+                           file.path.size() - dir_.size() - 5);
+            wallets_[id] = std::move(file.json);
+        }
     }
 
-    closedir(dir);
     return Status();
 }
 
@@ -21,6 +21,7 @@ namespace libbitcoin {
 
 struct block_header_type;
 struct transaction_type;
+class hd_private_key;
 
 } // namespace libbitcoin
 
@@ -35,12 +35,14 @@ enum
     msg_wakeup,
     msg_disconnect,
     msg_connect,
-    msg_send
+    msg_send,
+    msg_add,
+    msg_remove
 };
 
-Watcher::Watcher(Cache &cache):
+Watcher::Watcher(BlockCache &blocks, ServerCache &servers):
     socket_(zmqContext(), ZMQ_PAIR),
-    txu_(cache, zmqContext())
+    txu_(blocks, servers, zmqContext())
 {
     std::stringstream name;
     name << "inproc://watcher-" << watcher_id++;
@@ -50,6 +52,34 @@ Watcher::Watcher(Cache &cache):
     socket_.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
 }
 
+void
+Watcher::walletAdd(const std::string &id, std::shared_ptr<Cache> cache)
+{
+    std::lock_guard<std::mutex> lock(socket_mutex_);
+
+    auto cacheCopy = new std::shared_ptr<Cache>(std::move(cache));
+    auto cacheInt = reinterpret_cast<uintptr_t>(cacheCopy);
+
+    auto data = buildData({bc::to_byte(msg_add),
+                           bc::to_little_endian(cacheInt), DataSlice(id)
+                          });
+    socket_.send(data.data(), data.size());
+}
+
+void
+Watcher::walletRemove(const std::string &id, std::function<void ()> onRemoved)
+{
+    std::lock_guard<std::mutex> lock(socket_mutex_);
+
+    auto onRemovedCopy = new std::function<void ()>(std::move(onRemoved));
+    auto onRemovedInt = reinterpret_cast<uintptr_t>(onRemovedCopy);
+
+    auto data = buildData({bc::to_byte(msg_remove),
+                           bc::to_little_endian(onRemovedInt), DataSlice(id)
+                          });
+    socket_.send(data.data(), data.size());
+}
+
 void
 Watcher::sendWakeup()
 {
@@ -186,6 +216,28 @@ bool Watcher::command(uint8_t *data, size_t size)
         delete statusCopy;
     }
     return true;
+
+    case msg_add:
+    {
+        auto cacheInt = serial.read_little_endian<uintptr_t>();
+        auto cacheCopy = reinterpret_cast<std::shared_ptr<Cache> *>(cacheInt);
+        txu_.walletAdd(std::string(serial.iterator(), data + size),
+                       std::move(*cacheCopy));
+        delete cacheCopy;
+    }
+    return true;
+
+    case msg_remove:
+    {
+        auto onRemovedInt = serial.read_little_endian<uintptr_t>();
+        auto onRemovedCopy =
+            reinterpret_cast<std::function<void ()> *>(onRemovedInt);
+        txu_.walletRemove(std::string(serial.iterator(), data + size));
+        if (*onRemovedCopy)
+            (*onRemovedCopy)();
+        delete onRemovedCopy;
+    }
+    return true;
     }
 }
 
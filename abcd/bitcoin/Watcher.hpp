@@ -10,19 +10,31 @@
 
 #include "network/TxUpdater.hpp"
 #include <zmq.hpp>
+#include <functional>
 #include <mutex>
 
 namespace abcd {
 
 /**
  * Provides threading support for the TxUpdater object.
+ * There is one of these for the whole process,
+ * and the individual wallets attach and detach themselves as needed.
  */
 class Watcher
 {
 public:
-    Watcher(Cache &cache);
+    Watcher(BlockCache &blocks, ServerCache &servers);
 
     // - Updater messages: -------------
+    void walletAdd(const std::string &id, std::shared_ptr<Cache> cache);
+
+    /**
+     * Detaches a wallet from the updater.
+     * @param onRemoved Called on the watcher thread once the updater
+     * has let go of the wallet and finished any final save.
+     */
+    void walletRemove(const std::string &id,
+                      std::function<void ()> onRemoved=nullptr);
     void sendWakeup();
     void disconnect();
     void connect();
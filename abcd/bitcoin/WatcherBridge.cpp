@@ -15,38 +15,66 @@
 #include "../wallet/Receive.hpp"
 #include "../wallet/Wallet.hpp"
 #include <algorithm>
+#include <condition_variable>
 #include <list>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 namespace abcd {
 
 struct WatcherInfo
 {
 private:
-    // This needs to come first, since the watcher relies on it's lifetime:
+    // This needs to come first, since the wallet reference relies on it:
     std::shared_ptr<Wallet> parent_;
 
 public:
-    WatcherInfo(Wallet &wallet):
+    WatcherInfo(Wallet &wallet, std::shared_ptr<Watcher> engine):
         parent_(wallet.shared_from_this()),
-        watcher(wallet.cache),
+        engine(std::move(engine)),
         wallet(wallet)
     {
     }
 
-    Watcher watcher;
+    std::shared_ptr<Watcher> engine;
     Wallet &wallet;
     std::map<std::string, std::string> sweeping; // address to key
+    bool connected = false;
 
     tABC_BitCoin_Event_Callback fCallback;
     void *pData;
+
+    // The loop just waits for this, since the engine does the real work:
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool stopped = false;
+    bool attached = false; // True while the engine holds the wallet
 };
 
 static std::mutex watchersMutex_;
 static std::map<std::string, std::shared_ptr<WatcherInfo>> watchers_;
 
+// The network engine shared by all the running watchers:
+static std::shared_ptr<Watcher> engine_;
+static std::thread engineThread_;
+
+/**
+ * Disconnects the shared engine if no wallets want a connection.
+ * Must be called with the watchers mutex held.
+ */
+static void
+engineDisconnectIdle()
+{
+    for (const auto &watcher: watchers_)
+        if (watcher.second->connected)
+            return;
+
+    if (engine_)
+        engine_->disconnect();
+}
+
 /**
  * Returns a list of all watchers currently running.
  */
@@ -195,7 +223,15 @@ bridgeWatcherStart(Wallet &self)
         return ABC_ERROR(ABC_CC_Error,
                          "Watcher already exists for " + self.id());
 
-    watchers_[self.id()].reset(new WatcherInfo(self));
+    // The first watcher brings the shared engine to life:
+    if (!engine_)
+    {
+        engine_.reset(new Watcher(gContext->blockCache,
+                                  gContext->serverCache));
+        engineThread_ = std::thread(&Watcher::loop, engine_.get());
+    }
+
+    watchers_[self.id()].reset(new WatcherInfo(self, engine_));
 
     return Status();
 }
@@ -217,7 +253,7 @@ bridgeWatcherLoop(Wallet &self,
     // Set up the address-changed callback:
     auto wakeupCallback = [watcherInfo]()
     {
-        watcherInfo->watcher.sendWakeup();
+        watcherInfo->engine->sendWakeup();
     };
     self.cache.addresses.wakeupCallbackSet(wakeupCallback);
 
@@ -243,13 +279,50 @@ bridgeWatcherLoop(Wallet &self,
     };
     self.cache.addresses.onCompleteSet(onComplete);
 
-    // Do the loop:
-    watcherInfo->watcher.loop();
+    // Keep the gap limit ahead of any activity the server finds:
+    auto onUsed = [watcherInfo](const std::string &address)
+    {
+        watcherInfo->wallet.addresses.recycleSet(address, false).log();
+    };
+    self.cache.addresses.onUsedSet(onUsed);
+
+    // Hand the wallet to the shared engine, and wait to be stopped.
+    // The engine's reference keeps the wallet alive until it lets go:
+    std::shared_ptr<Cache> cache(self.shared_from_this(), &self.cache);
+    {
+        std::lock_guard<std::mutex> lock(watcherInfo->stopMutex);
+        watcherInfo->attached = true;
+    }
+    watcherInfo->engine->walletAdd(self.id(), cache);
+    {
+        std::unique_lock<std::mutex> lock(watcherInfo->stopMutex);
+        watcherInfo->stopCondition.wait(lock, [watcherInfo]()
+        {
+            return watcherInfo->stopped;
+        });
+        watcherInfo->stopped = false;
+    }
+
+    // The engine may still be saving the cache, so `bridgeWatcherDelete`
+    // waits for it to confirm the removal before saving again:
+    auto onRemoved = [watcherInfo]()
+    {
+        std::lock_guard<std::mutex> lock(watcherInfo->stopMutex);
+        watcherInfo->attached = false;
+        watcherInfo->stopCondition.notify_all();
+    };
+    watcherInfo->engine->walletRemove(self.id(), onRemoved);
+    {
+        std::lock_guard<std::mutex> lock(watchersMutex_);
+        watcherInfo->connected = false;
+        engineDisconnectIdle();
+    }
 
     // Cancel all callbacks:
     self.cache.addresses.wakeupCallbackSet(nullptr);
     self.cache.addresses.onTxSet(nullptr);
     self.cache.addresses.onCompleteSet(nullptr);
+    self.cache.addresses.onUsedSet(nullptr);
     watcherInfo->fCallback = nullptr;
     watcherInfo->pData = nullptr;
 
@@ -262,7 +335,11 @@ bridgeWatcherConnect(Wallet &self)
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.connect();
+    {
+        std::lock_guard<std::mutex> lock(watchersMutex_);
+        watcherInfo->connected = true;
+    }
+    watcherInfo->engine->connect();
 
     return Status();
 }
@@ -273,7 +350,7 @@ watcherSend(Wallet &self, StatusCallback status, DataSlice tx)
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.sendTx(status, tx);
+    watcherInfo->engine->sendTx(status, tx);
 
     return Status();
 }
@@ -284,7 +361,9 @@ bridgeWatcherDisconnect(Wallet &self)
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.disconnect();
+    std::lock_guard<std::mutex> lock(watchersMutex_);
+    watcherInfo->connected = false;
+    engineDisconnectIdle();
 
     return Status();
 }
@@ -295,7 +374,10 @@ bridgeWatcherStop(Wallet &self)
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.stop();
+    std::lock_guard<std::mutex> lock(watcherInfo->stopMutex);
+    watcherInfo->stopped = true;
+    watcherInfo->stopCondition.notify_all();
+    ABC_DebugLog("Watcher stopped for %s", self.id().c_str());
 
     return Status();
 }
@@ -303,10 +385,38 @@ bridgeWatcherStop(Wallet &self)
 Status
 bridgeWatcherDelete(Wallet &self)
 {
+    // Only save once the engine has let go of the wallet,
+    // since it saves the cache from its own thread:
+    std::shared_ptr<WatcherInfo> watcherInfo;
+    if (watcherFind(watcherInfo, self))
+    {
+        std::unique_lock<std::mutex> lock(watcherInfo->stopMutex);
+        watcherInfo->stopCondition.wait(lock, [watcherInfo]()
+        {
+            return !watcherInfo->attached;
+        });
+    }
     self.cache.save().log(); // Failure is fine
 
-    std::lock_guard<std::mutex> lock(watchersMutex_);
-    watchers_.erase(self.id());
+    // The last watcher shuts down the shared engine:
+    std::shared_ptr<Watcher> engine;
+    std::thread engineThread;
+    {
+        std::lock_guard<std::mutex> lock(watchersMutex_);
+        watchers_.erase(self.id());
+        if (watchers_.empty() && engine_)
+        {
+            engine = std::move(engine_);
+            engineThread = std::move(engineThread_);
+        }
+    }
+
+    // The engine's callbacks need the watchers mutex, so join without it:
+    if (engine)
+    {
+        engine->stop();
+        engineThread.join();
+    }
 
     return Status();
 }
@@ -15,6 +15,7 @@ namespace abcd {
 
 constexpr auto periodDefault = 20;
 constexpr auto periodPriority = 4;
+constexpr auto periodMax = 10 * 60;
 
 struct CacheJson:
     public JsonObject
@@ -34,6 +35,8 @@ struct AddressJson:
     ABC_JSON_VALUE(txids, "txids", JsonArray)
     ABC_JSON_INTEGER(lastCheck, "lastCheck", 0)
     ABC_JSON_STRING(stratumHash, "stratumHash", 0)
+    ABC_JSON_INTEGER(period, "period", 0)
+    ABC_JSON_BOOLEAN(checked, "checked", false)
 };
 
 bool
@@ -62,9 +65,19 @@ AddressCache::clear()
     std::lock_guard<std::recursive_mutex> lock(mutex_);
 
     priorityAddress_ = "";
+    {
+        std::lock_guard<std::mutex> namesLock(namesMutex_);
+        knownTxids_.clear();
+        unnamedTxids_.clear();
+        ++knownRevision_;
+    }
+    schedule_.clear();
+    urgent_.clear();
     for (auto &row: rows_)
+    {
         row.second = AddressRow();
-    knownTxids_.clear();
+        reschedule(row.first, row.second);
+    }
 }
 
 Status
@@ -95,13 +108,21 @@ AddressCache::load(JsonObject &json)
 
             row.dirty = addressJson.dirty();
             row.lastCheck = addressJson.lastCheck();
-            if (now < nextCheck(address, row))
+            row.period = std::min<time_t>(addressJson.period(), periodMax);
+
+            // Older caches don't say whether the address was ever checked:
+            if (addressJson.checkedOk())
+                row.checkedOnce = addressJson.checked();
+            else if (now < nextCheck(address, row))
                 row.checkedOnce = true;
 
             if (addressJson.stratumHashOk())
                 row.stratumHash = addressJson.stratumHash();
 
-            rows_[address] = row;
+            auto &slot = rows_[address];
+            row.scheduled = slot.scheduled;
+            slot = row;
+            reschedule(address, slot);
         }
     }
     updateInternal();
@@ -133,6 +154,9 @@ AddressCache::save(JsonObject &json)
         ABC_CHECK(address.lastCheckSet(row.second.lastCheck));
         if (!row.second.stratumHash.empty())
             ABC_CHECK(address.stratumHashSet(row.second.stratumHash));
+        if (row.second.period)
+            ABC_CHECK(address.periodSet(row.second.period));
+        ABC_CHECK(address.checkedSet(row.second.checkedOnce));
         ABC_CHECK(addressesJson.append(address));
     }
     cacheJson.addressesSet(addressesJson);
@@ -159,20 +183,22 @@ AddressCache::statuses(time_t &sleep) const
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     std::list<AddressStatus> out;
 
+    // Gather the addresses with work due:
     time_t now = time(nullptr);
-    time_t nextCheck = now;
-    for (auto &row: rows_)
+    AddressSet due = urgent_;
+    auto next = schedule_.begin();
+    for (; schedule_.end() != next && next->first <= now; ++next)
+        due.insert(next->second);
+
+    for (const auto &address: due)
     {
-        const auto s = status(row.first, row.second, now);
+        const auto s = status(address, rows_.at(address), now);
         if (s.dirty || s.needsCheck || s.missingTxids.size())
             out.push_back(std::move(s));
-
-        if (now < s.nextCheck
-                && (s.nextCheck < nextCheck || now == nextCheck))
-            nextCheck = s.nextCheck;
     }
 
-    sleep = nextCheck - now;
+    // The first future check tells us how long to sleep:
+    sleep = schedule_.end() != next ? next->first - now : 0;
     out.sort();
     return out;
 }
@@ -184,6 +210,45 @@ AddressCache::txids() const
     return knownTxids_;
 }
 
+bool
+AddressCache::txidKnown(const std::string &txid) const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return knownTxids_.count(txid);
+}
+
+size_t
+AddressCache::txidsRevision() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return knownRevision_;
+}
+
+TxidSet
+AddressCache::txidsUnnamed() const
+{
+    std::lock_guard<std::mutex> lock(namesMutex_);
+    return unnamedTxids_;
+}
+
+AddressSet
+AddressCache::list() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    AddressSet out;
+    for (const auto &row: rows_)
+        out.insert(row.first);
+    return out;
+}
+
+bool
+AddressCache::contains(const std::string &address) const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return rows_.count(address);
+}
+
 void
 AddressCache::insert(const std::string &address, bool sweep)
 {
@@ -193,6 +258,7 @@ AddressCache::insert(const std::string &address, bool sweep)
     {
         auto &row = rows_[address];
         row.sweep = sweep;
+        reschedule(address, row);
 
         if (wakeupCallback_)
             wakeupCallback_();
@@ -213,7 +279,15 @@ AddressCache::prioritize(const std::string &address)
 {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
 
+    // Both the old and new priority addresses change their schedule:
+    const auto old = priorityAddress_;
     priorityAddress_ = address;
+    for (const auto &changed: {old, address})
+    {
+        auto i = rows_.find(changed);
+        if (rows_.end() != i)
+            reschedule(i->first, i->second);
+    }
 
     if (wakeupCallback_)
         wakeupCallback_();
@@ -239,7 +313,7 @@ AddressCache::update(const std::string &address, const TxidSet &txids)
         if (!txids.count(txid) && txCache_.drop(txid))
         {
             drops.insert(txid);
-            knownTxids_.erase(txid);
+            knownErase(txid);
         }
     }
 
@@ -249,16 +323,27 @@ AddressCache::update(const std::string &address, const TxidSet &txids)
             row.second.txids.erase(txid);
 
     // Look for new txids:
+    bool active = !drops.empty();
+    const bool used = row.txids.empty() && !txids.empty() && !row.sweep;
     for (const auto &txid: txids)
+    {
         if (!row.txids.count(txid))
+        {
             row.insertTxid(txid);
+            active = true;
+        }
+    }
 
     // Update timestamp:
     row.dirty = false;
     row.lastCheck = time(nullptr);
     row.checkedOnce = true;
+    backoff(row, active);
+    reschedule(address, row);
 
     // Fire callbacks:
+    if (used && onUsed_)
+        onUsed_(address);
     updateInternal();
 }
 
@@ -285,7 +370,32 @@ AddressCache::updateSubscribe(const std::string &address)
     auto &row = rows_[address];
 
     if (row.checkedOnce)
+    {
         row.lastCheck = time(nullptr);
+        backoff(row, false);
+    }
+    reschedule(address, row);
+}
+
+void
+AddressCache::txidNamed(const std::string &txid, bool named)
+{
+    std::lock_guard<std::mutex> lock(namesMutex_);
+
+    // The count can dip below zero if removals overtake insertions:
+    auto &count = namedTxids_[txid];
+    count += named ? 1 : -1;
+    if (0 < count)
+    {
+        unnamedTxids_.erase(txid);
+    }
+    else
+    {
+        if (!count)
+            namedTxids_.erase(txid);
+        if (knownTxids_.count(txid))
+            unnamedTxids_.insert(txid);
+    }
 }
 
 std::string
@@ -313,11 +423,19 @@ AddressCache::updateStratumHash(const std::string &address,
         return true;
     auto &row = i->second;
 
-    row.dirty |= (row.stratumHash.empty() || hash != row.stratumHash);
+    // A changed hash means the address just saw some activity:
+    if (!row.stratumHash.empty() && !hash.empty() && hash != row.stratumHash)
+        backoff(row, true);
+
+    // An empty hash is only news if we think the address has a history:
+    const bool same = hash == row.stratumHash &&
+                      (!hash.empty() || (row.checkedOnce && row.txids.empty()));
+    row.dirty |= !same;
     if (!hash.empty())
         row.stratumHash = hash;
     if (!row.dirty)
         row.checkedOnce = true;
+    reschedule(address, row);
     return row.dirty;
 }
 
@@ -342,16 +460,67 @@ AddressCache::onCompleteSet(const CompleteCallback &onComplete)
     onComplete_ = onComplete;
 }
 
+void
+AddressCache::onUsedSet(const UsedCallback &onUsed)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    onUsed_ = onUsed;
+}
+
 time_t
 AddressCache::nextCheck(const std::string &address, const AddressRow &row) const
 {
-    time_t period = periodDefault;
+    time_t period = row.period ? row.period : periodDefault;
     if (priorityAddress_ == address)
         period = periodPriority;
 
     return row.lastCheck + period;
 }
 
+void
+AddressCache::backoff(AddressRow &row, bool active)
+{
+    if (active || row.txids.empty())
+        row.period = periodDefault;
+    else
+        row.period = std::min<time_t>(
+                         2 * (row.period ? row.period : periodDefault), periodMax);
+}
+
+void
+AddressCache::reschedule(const std::string &address, AddressRow &row)
+{
+    schedule_.erase(std::make_pair(row.scheduled, address));
+    row.scheduled = nextCheck(address, row);
+    schedule_.insert(std::make_pair(row.scheduled, address));
+
+    if (row.dirty || !row.complete)
+        urgent_.insert(address);
+    else
+        urgent_.erase(address);
+}
+
+void
+AddressCache::knownInsert(const std::string &txid)
+{
+    std::lock_guard<std::mutex> lock(namesMutex_);
+    knownTxids_.insert(txid);
+    ++knownRevision_;
+
+    const auto named = namedTxids_.find(txid);
+    if (namedTxids_.end() == named || named->second <= 0)
+        unnamedTxids_.insert(txid);
+}
+
+void
+AddressCache::knownErase(const std::string &txid)
+{
+    std::lock_guard<std::mutex> lock(namesMutex_);
+    knownTxids_.erase(txid);
+    unnamedTxids_.erase(txid);
+    ++knownRevision_;
+}
+
 AddressStatus
 AddressCache::status(const std::string &address, const AddressRow &row,
                      time_t now) const
@@ -394,11 +563,15 @@ AddressCache::updateInternal()
             // Don't notify the GUI about sweep transactions:
             if (!row.second.sweep)
             {
-                knownTxids_.insert(txid);
+                knownInsert(txid);
                 if (onTx_)
                     onTx_(txid);
             }
         }
+
+        // Still-incomplete rows are already in the right place:
+        if (row.second.complete)
+            reschedule(row.first, row.second);
     }
 
     // Check for newly-completed addresses:
@@ -13,6 +13,7 @@
 #include <time.h>
 #include <map>
 #include <mutex>
+#include <set>
 
 namespace abcd {
 
@@ -56,11 +57,14 @@ operator <(const AddressStatus &a, const AddressStatus &b);
  * The long-term plan is to make this class work with the transaction cache.
  * It should be able to pick good poll frequencies for each address,
  * and should also generate new addresses based on the HD gap limit.
- * This class should also cache its contents on disk,
- * avoiding the need to re-check everything on each login.
  *
  * This will allow the `AddressDb` to be a simple metadata store,
  * with no need to handle Bitcoin-specific knowledge.
+ *
+ * The cache keeps each address's polling schedule on disk,
+ * so a fresh login only re-checks the addresses that are actually due.
+ * Addresses with unconfirmed transactions are caught by the block height
+ * check, since `BlockCache` remembers the last height it saw.
  */
 class AddressCache
 {
@@ -68,6 +72,7 @@ public:
     typedef std::function<void ()> Callback;
     typedef std::function<void (const std::string &txid)> TxidCallback;
     typedef std::function<void (const std::string &address)> CompleteCallback;
+    typedef std::function<void (const std::string &address)> UsedCallback;
 
     // Lifetime ------------------------------------------------------------
 
@@ -113,6 +118,40 @@ public:
     TxidSet
     txids() const;
 
+    /**
+     * Returns true if the transaction is relevant to these addresses,
+     * without copying the whole `txids` set.
+     */
+    bool
+    txidKnown(const std::string &txid) const;
+
+    /**
+     * Lists the relevant transactions that no metadata names by txid,
+     * such as new, malleated, or legacy ones.
+     * This is normally a small subset of `txids`.
+     */
+    TxidSet
+    txidsUnnamed() const;
+
+    /**
+     * Returns a number that changes whenever `txids` does,
+     * so callers can tell when their derived data is out of date.
+     */
+    size_t
+    txidsRevision() const;
+
+    /**
+     * Lists the addresses this cache is watching.
+     */
+    AddressSet
+    list() const;
+
+    /**
+     * Returns true if this cache is watching the address.
+     */
+    bool
+    contains(const std::string &address) const;
+
     // Updates -------------------------------------------------------------
 
     /**
@@ -153,6 +192,14 @@ public:
     void
     updateSubscribe(const std::string &address);
 
+    /**
+     * Notes that a metadata record has started or stopped naming a txid.
+     * This never waits on the main lock, so the metadata database
+     * can call it while holding its own lock.
+     */
+    void
+    txidNamed(const std::string &txid, bool named);
+
     /**
      * Gets the stratumHash of an address;
      */
@@ -162,7 +209,8 @@ public:
 
     /**
      * Updates the state hash stored with the address.
-     * Returns true if the new hash differs from the old hash.
+     * An empty hash means the server knows no history for the address.
+     * Returns true if the address needs its history fetched.
      */
     bool
     updateStratumHash(const std::string &address, const std::string &hash="");
@@ -186,6 +234,14 @@ public:
     void
     onCompleteSet(const CompleteCallback &onComplete);
 
+    /**
+     * Provides a callback to be notified when the server first reports
+     * history for an address, before the transactions themselves arrive.
+     * This lets the wallet extend its gap limit without waiting.
+     */
+    void
+    onUsedSet(const UsedCallback &onUsed);
+
 private:
     mutable std::recursive_mutex mutex_; // The callbacks force this on us
     TxCache &txCache_;
@@ -197,14 +253,18 @@ private:
         TxidSet txids;
         time_t lastCheck = 0;
         std::string stratumHash;
-
-        // Dynamic state:
         bool dirty = true;
         bool checkedOnce = false;
+
+        // Dynamic state:
         bool complete = false; // True if all txids are known to the GUI.
         bool knownComplete = false; // True if `onComplete` has been called.
         bool sweep = false; // True if we don't own this address
 
+        // Scheduling state:
+        time_t period = 0; // Polling period, or 0 for the default (saved).
+        time_t scheduled = 0; // Our position in the schedule.
+
         void
         insertTxid(const std::string &txid)
         {
@@ -218,20 +278,70 @@ private:
     /**
      * Transactions that are relevant, in the cache,
      * and that the GUI knows about.
+     * Changes need both locks, but reads only need one.
      */
     TxidSet knownTxids_;
+    size_t knownRevision_ = 1;
+
+    // The number of metadata records naming each txid,
+    // and the known txids with none (guarded by the names lock):
+    mutable std::mutex namesMutex_;
+    std::map<std::string, int> namedTxids_;
+    TxidSet unnamedTxids_;
+
+    /**
+     * The next check time for each address, earliest first.
+     * Together with the urgent list, this lets `statuses` visit
+     * only the addresses that actually have work due.
+     */
+    std::set<std::pair<time_t, std::string> > schedule_;
+
+    /**
+     * Addresses that are dirty or have incomplete transactions,
+     * which need attention regardless of the schedule.
+     */
+    AddressSet urgent_;
 
     Callback wakeupCallback_;
     TxidCallback onTx_;
     CompleteCallback onComplete_;
+    UsedCallback onUsed_;
 
     time_t
     nextCheck(const std::string &address, const AddressRow &row) const;
 
+    /**
+     * Adjusts an address's polling period after a check.
+     * Active addresses go back to the default period,
+     * while quiet addresses with a history back off gradually.
+     * Empty addresses are usually waiting for a payment,
+     * so they stay at the default.
+     */
+    void
+    backoff(AddressRow &row, bool active);
+
+    /**
+     * Moves an address to the right place in the schedule.
+     * This must be called whenever anything affecting
+     * `nextCheck` or the dirty & complete flags changes.
+     */
+    void
+    reschedule(const std::string &address, AddressRow &row);
+
     AddressStatus
     status(const std::string &address, const AddressRow &row,
            time_t now) const;
 
+    /**
+     * Adds or removes a known txid, keeping the unnamed list current.
+     * Should be called with the main lock held.
+     */
+    void
+    knownInsert(const std::string &txid);
+
+    void
+    knownErase(const std::string &txid);
+
     void
     updateInternal();
 };
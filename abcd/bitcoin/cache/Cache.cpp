@@ -11,9 +11,9 @@
 
 namespace abcd {
 
-Cache::Cache(const std::string &path, BlockCache &blockCache,
-             ServerCache &serverCache):
-    txs(blockCache),
+Cache::Cache(const std::string &path, const std::string &txsPath,
+             BlockCache &blockCache, ServerCache &serverCache):
+    txs(blockCache, txsPath),
     blocks(blockCache),
     addresses(txs),
     servers(serverCache),
@@ -38,7 +38,11 @@ Cache::load()
     JsonObject cacheJson;
     servers.load();
     ABC_CHECK(cacheJson.load(path_));
-    ABC_CHECK(txs.load(cacheJson));
+
+    // Older caches keep their transactions in the JSON file:
+    if (!txs.load().log())
+        ABC_CHECK(txs.loadJson(cacheJson));
+
     ABC_CHECK(addresses.load(cacheJson));
     addressCheckDoneLoad(cacheJson);
     return Status();
@@ -148,8 +152,9 @@ Cache::loadLegacy(const std::string &path)
 Status
 Cache::save()
 {
+    ABC_CHECK(txs.save());
+
     JsonObject cacheJson;
-    ABC_CHECK(txs.save(cacheJson));
     ABC_CHECK(addresses.save(cacheJson));
     ABC_CHECK(addressCheckDoneSave(cacheJson));
     ABC_CHECK(cacheJson.save(path_));
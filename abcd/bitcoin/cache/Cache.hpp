@@ -23,8 +23,12 @@ public:
     AddressCache addresses;
     ServerCache &servers;
 
-    Cache(const std::string &path, BlockCache &blockCache,
-          ServerCache &serverCache);
+    /**
+     * @param path The JSON cache file.
+     * @param txsPath The binary transaction cache file.
+     */
+    Cache(const std::string &path, const std::string &txsPath,
+          BlockCache &blockCache, ServerCache &serverCache);
 
     /**
      * Sets the address check done for this wallet meaning that
@@ -12,31 +12,12 @@
 #include "../../json/JsonArray.hpp"
 #include "../../json/JsonObject.hpp"
 #include "../../util/Debug.hpp"
-#include <unordered_set>
-
-namespace std {
-
-/**
- * Allows `bc::point_type` to be used with `std::unordered_set`.
- */
-template<> struct hash<bc::point_type>
-{
-    typedef bc::point_type argument_type;
-    typedef std::size_t result_type;
-
-    result_type
-    operator()(argument_type const &p) const
-    {
-        auto h = libbitcoin::from_little_endian_unsafe<result_type>(
-                     p.hash.begin());
-        return h ^ p.index;
-    }
-};
-
-} // namespace std
 
 namespace abcd {
 
+// Decoded transactions to keep around, beyond the ones in use:
+constexpr size_t recentLimit = 1024;
+
 libbitcoin::output_info_list
 filterOutputs(const TxOutputList &utxos, bool filter)
 {
@@ -55,85 +36,26 @@ filterOutputs(const TxOutputList &utxos, bool filter)
     return out;
 }
 
-typedef std::unordered_set<bc::point_type> PointSet;
-
 /**
- * Knows how to check a transaction for double-spends and other problems.
- * This uses a memoized recursive function to do the graph search,
- * so the more checks this object performs,
- * the faster those checks can potentially become (for a fixed graph).
+ * Converts a txid to binary at the API boundary.
+ * Invalid txids become the null hash, which never names a real transaction.
  */
-class TxGraph
+static bc::hash_digest
+txidDecode(const std::string &txid)
 {
-public:
-    static constexpr unsigned doubleSpent = 1 << 0;
-    static constexpr unsigned replaceByFee = 1 << 1;
-
-    TxGraph(const TxCache &cache):
-        cache_(cache)
-    {
-        for (auto &row: cache_.txs_)
-        {
-            for (auto &input: row.second.inputs)
-            {
-                if (!spends_.insert(input.previous_output).second)
-                    doubleSpends_.insert(input.previous_output);
-            }
-        }
-    }
-
-    /**
-     * Returns true if the output point has been spent from.
-     */
-    bool isSpent(bc::output_point point)
-    {
-        return spends_.count(point);
-    }
-
-    /**
-     * Recursively checks the transaction graph for problems.
-     * @return A bitfield containing problem flags.
-     */
-    unsigned
-    problems(const std::string &txid)
-    {
-        // Just use the previous result if we have been here before:
-        auto vi = visited_.find(txid);
-        if (visited_.end() != vi)
-            return vi->second;
-
-        // We have to assume missing transactions are safe:
-        auto i = cache_.txs_.find(txid);
-        if (cache_.txs_.end() == i)
-            return (visited_[txid] = 0);
-
-        // Confirmed transactions are also safe:
-        if (cache_.txidHeight(txid))
-            return (visited_[txid] = 0);
-
-        // Check for the opt-in replace-by-fee flag:
-        unsigned out = 0;
-        if (isReplaceByFee(i->second))
-            out |= replaceByFee;
-
-        // Recursively check all the inputs:
-        for (const auto &input: i->second.inputs)
-        {
-            out |= problems(bc::encode_hash(input.previous_output.hash));
-            if (doubleSpends_.count(input.previous_output))
-                out |= doubleSpent;
-        }
-        return (visited_[txid] = out);
-    }
-
-private:
-    const TxCache &cache_;
+    bc::hash_digest out;
+    if (!bc::decode_hash(out, txid))
+        return bc::null_hash;
+    return out;
+}
 
-    PointSet spends_;
-    PointSet doubleSpends_;
-    std::map<std::string, unsigned> visited_;
-};
+// Problem flags:
+constexpr unsigned doubleSpent = 1 << 0;
+constexpr unsigned replaceByFee = 1 << 1;
 
+/**
+ * The legacy JSON cache format, which is still needed for migration.
+ */
 struct CacheJson:
     public JsonObject
 {
@@ -163,8 +85,9 @@ struct HeightJson:
 };
 
 
-TxCache::TxCache(BlockCache &blockCache):
-    blocks_(blockCache)
+TxCache::TxCache(BlockCache &blockCache, const std::string &path):
+    blocks_(blockCache),
+    log_(path)
 {
 }
 
@@ -174,10 +97,52 @@ TxCache::clear()
     std::lock_guard<std::mutex> lock(mutex_);
     txs_.clear();
     heights_.clear();
+    recent_.clear();
+    graphReset();
+    log_.rewrite();
+}
+
+Status
+TxCache::load()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    txs_.clear();
+    heights_.clear();
+    recent_.clear();
+
+    // The raw transactions stay in the file mapping until somebody asks:
+    auto onTx = [this](const bc::hash_digest &txid, DataSlice rawTx)
+    {
+        erase(txid);
+        txs_[txid].raw = rawTx;
+    };
+    auto onHeight = [this](const bc::hash_digest &txid,
+                           size_t height, time_t firstSeen)
+    {
+        auto &info = heights_[txid];
+        info.height = height;
+        info.firstSeen = firstSeen;
+    };
+    auto onDrop = [this](const bc::hash_digest &txid)
+    {
+        erase(txid);
+        heights_.erase(txid);
+    };
+    auto s = log_.load(onTx, onHeight, onDrop);
+
+    // Even a failed load leaves the graph matching the contents,
+    // but there is no need to decode everything until somebody asks:
+    for (const auto &height: heights_)
+        blocks_.headerNeededAdd(height.second.height);
+    graphReset();
+
+    if (!s)
+        return s.at(ABC_HERE());
+    return Status();
 }
 
 Status
-TxCache::load(JsonObject &json)
+TxCache::loadJson(JsonObject &json)
 {
     std::lock_guard<std::mutex> lock(mutex_);
     CacheJson cacheJson(json);
@@ -188,14 +153,17 @@ TxCache::load(JsonObject &json)
     for (size_t i = 0; i < txsSize; i++)
     {
         TxJson txJson(txsJson[i]);
-        if (txJson.txidOk() && txJson.dataOk())
+        bc::hash_digest hash;
+        if (txJson.txidOk() && txJson.dataOk() &&
+                bc::decode_hash(hash, txJson.txid()))
         {
             DataChunk rawTx;
             ABC_CHECK(base64Decode(rawTx, txJson.data()));
-            bc::transaction_type tx;
-            ABC_CHECK(decodeTx(tx, rawTx));
+            auto tx = std::make_shared<bc::transaction_type>();
+            ABC_CHECK(decodeTx(*tx, rawTx));
 
-            txs_[txJson.txid()] = std::move(tx);
+            erase(hash);
+            txs_[hash].tx = tx;
         }
     }
 
@@ -205,51 +173,47 @@ TxCache::load(JsonObject &json)
     for (size_t i = 0; i < heightsSize; i++)
     {
         HeightJson heightJson(heightsJson[i]);
-        if (heightJson.txidOk())
+        bc::hash_digest hash;
+        if (heightJson.txidOk() && bc::decode_hash(hash, heightJson.txid()))
         {
             HeightInfo info;
             info.height = heightJson.height();
             info.firstSeen = heightJson.firstSeen();
-            heights_[heightJson.txid()] = info;
+            heights_[hash] = info;
             blocks_.headerNeededAdd(info.height);
         }
     }
 
+    graphReset();
+
+    // Everything we just loaded needs to go into the binary file:
+    log_.rewrite();
+
     return Status();
 }
 
 Status
-TxCache::save(JsonObject &json)
+TxCache::save()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    CacheJson cacheJson(json);
+    // Holding the file mutex keeps the batches in order,
+    // while leaving the cache available during the disk access:
+    std::lock_guard<std::mutex> fileLock(fileMutex_);
 
-    // Tx data:
-    JsonArray txsJson;
-    for (const auto &tx: txs_)
+    TxLog::Batch batch;
     {
-        bc::data_chunk rawTx(satoshi_raw_size(tx.second));
-        bc::satoshi_save(tx.second, rawTx.begin());
-
-        TxJson txJson;
-        ABC_CHECK(txJson.txidSet(tx.first));
-        ABC_CHECK(txJson.dataSet(base64Encode(rawTx)));
-        ABC_CHECK(txsJson.append(txJson));
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (log_.stale(txs_.size() + heights_.size()))
+            rewriteLog();
+        batch = log_.detach();
     }
-    cacheJson.txsSet(txsJson);
 
-    // Heights:
-    JsonArray heightsJson;
-    for (const auto &height: heights_)
+    auto s = log_.write(batch);
+    if (!s)
     {
-        HeightJson heightJson;
-        ABC_CHECK(heightJson.txidSet(height.first));
-        if (height.second.height)
-            ABC_CHECK(heightJson.heightSet(height.second.height));
-        ABC_CHECK(heightJson.firstSeenSet(height.second.firstSeen));
-        ABC_CHECK(heightsJson.append(heightJson));
+        std::lock_guard<std::mutex> lock(mutex_);
+        log_.writeFailed();
+        return s.at(ABC_HERE());
     }
-    cacheJson.heightsSet(heightsJson);
 
     return Status();
 }
@@ -259,11 +223,11 @@ TxCache::get(bc::transaction_type &result, const std::string &txid) const
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto i = txs_.find(txid);
-    if (txs_.end() == i)
+    const auto tx = find(txidDecode(txid));
+    if (!tx)
         return ABC_ERROR(ABC_CC_Synchronizing, "Cannot find transaction");
 
-    result = i->second;
+    result = *tx;
     return Status();
 }
 
@@ -278,9 +242,8 @@ TxCache::info(TxInfo &result, const bc::transaction_type &tx) const
 Status
 TxCache::info(TxInfo &result, const std::string &txid) const
 {
-    bc::transaction_type tx;
-    ABC_CHECK(get(tx, txid));
-    ABC_CHECK(info(result, tx));
+    std::lock_guard<std::mutex> lock(mutex_);
+    ABC_CHECK(infoCached(result, txidDecode(txid)));
     return Status();
 }
 
@@ -297,13 +260,15 @@ TxCache::infoInternal(TxInfo &result, const bc::transaction_type &tx) const
     // Scan inputs:
     for (const auto &input: tx.inputs)
     {
-        const auto txid = bc::encode_hash(input.previous_output.hash);
-        auto i = txs_.find(txid);
-        if (txs_.end() == i)
-            return ABC_ERROR(ABC_CC_Synchronizing, "Missing input " + txid);
-        if (i->second.outputs.size() <= input.previous_output.index)
-            return ABC_ERROR(ABC_CC_Error, "Impossible input on " + txid);
-        auto &output = i->second.outputs[input.previous_output.index];
+        const auto &prevHash = input.previous_output.hash;
+        const auto prev = find(prevHash);
+        if (!prev)
+            return ABC_ERROR(ABC_CC_Synchronizing,
+                             "Missing input " + bc::encode_hash(prevHash));
+        if (prev->outputs.size() <= input.previous_output.index)
+            return ABC_ERROR(ABC_CC_Error,
+                             "Impossible input on " + bc::encode_hash(prevHash));
+        auto &output = prev->outputs[input.previous_output.index];
 
         totalIn += output.value;
         bc::payment_address address;
@@ -326,29 +291,57 @@ TxCache::infoInternal(TxInfo &result, const bc::transaction_type &tx) const
     return Status();
 }
 
+Status
+TxCache::infoCached(TxInfo &result, const bc::hash_digest &txid) const
+{
+    const auto i = infos_.find(txid);
+    if (infos_.end() != i)
+    {
+        result = i->second;
+        return Status();
+    }
+
+    const auto tx = find(txid);
+    if (!tx)
+        return ABC_ERROR(ABC_CC_Synchronizing, "Cannot find transaction");
+
+    // Failures are not remembered, since the missing inputs may arrive:
+    ABC_CHECK(infoInternal(result, *tx));
+    infos_[txid] = result;
+    return Status();
+}
+
+void
+TxCache::infoInvalidate(const bc::hash_digest &txid)
+{
+    infos_.erase(txid);
+
+    const auto children = children_.find(txid);
+    if (children_.end() != children)
+        for (const auto &child: children->second)
+            infos_.erase(child);
+}
+
 bool
-TxCache::missing(const std::string &txid) const
+TxCache::missing(const std::string &txid)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
     // Check the transaction:
-    auto i = txs_.find(txid);
-    if (txs_.end() == i)
+    const auto tx = findValid(txidDecode(txid));
+    if (!tx)
         return true;
 
     // Check the inputs:
-    for (const auto &input: i->second.inputs)
-    {
-        const auto txid = bc::encode_hash(input.previous_output.hash);
-        if (!txs_.count(txid))
+    for (const auto &input: tx->inputs)
+        if (!findValid(input.previous_output.hash))
             return true;
-    }
 
     return false;
 }
 
 TxidSet
-TxCache::missingTxids(const TxidSet &txids) const
+TxCache::missingTxids(const TxidSet &txids)
 {
     std::lock_guard<std::mutex> lock(mutex_);
     TxidSet out;
@@ -356,20 +349,17 @@ TxCache::missingTxids(const TxidSet &txids) const
     for (const auto &txid: txids)
     {
         // Check the transaction:
-        auto i = txs_.find(txid);
-        if (txs_.end() == i)
+        const auto tx = findValid(txidDecode(txid));
+        if (!tx)
         {
             out.insert(txid);
             continue;
         }
 
         // Check the inputs:
-        for (const auto &input: i->second.inputs)
-        {
-            const auto txid = bc::encode_hash(input.previous_output.hash);
-            if (!txs_.count(txid))
-                out.insert(txid);
-        }
+        for (const auto &input: tx->inputs)
+            if (!findValid(input.previous_output.hash))
+                out.insert(bc::encode_hash(input.previous_output.hash));
     }
 
     return out;
@@ -378,12 +368,16 @@ TxCache::missingTxids(const TxidSet &txids) const
 Status
 TxCache::status(TxStatus &result, const std::string &txid) const
 {
-    TxGraph graph(*this);
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    graphBuild();
+
+    const auto hash = txidDecode(txid);
     TxStatus out;
-    out.height = txidHeight(txid);
-    const auto problems = graph.problems(txid);
-    out.isDoubleSpent = problems & TxGraph::doubleSpent;
-    out.isReplaceByFee = problems & TxGraph::replaceByFee;
+    out.height = txidHeight(hash);
+    const auto flags = problems(hash);
+    out.isDoubleSpent = flags & doubleSpent;
+    out.isReplaceByFee = flags & replaceByFee;
 
     result = out;
     return Status();
@@ -393,19 +387,19 @@ std::list<std::pair<TxInfo, TxStatus> >
 TxCache::statuses(const TxidSet &txids) const
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    graphBuild();
     std::list<std::pair<TxInfo, TxStatus>> out;
 
-    TxGraph graph(*this);
     for (const auto &txid: txids)
     {
-        auto i = txs_.find(txid);
+        const auto hash = txidDecode(txid);
         std::pair<TxInfo, TxStatus> pair;
-        if (txs_.end() != i && infoInternal(pair.first, i->second))
+        if (infoCached(pair.first, hash))
         {
-            pair.second.height = txidHeight(i->first);
-            const auto problems = graph.problems(i->first);
-            pair.second.isDoubleSpent = problems & TxGraph::doubleSpent;
-            pair.second.isReplaceByFee = problems & TxGraph::replaceByFee;
+            pair.second.height = txidHeight(hash);
+            const auto flags = problems(hash);
+            pair.second.isDoubleSpent = flags & doubleSpent;
+            pair.second.isReplaceByFee = flags & replaceByFee;
             out.push_back(pair);
         }
     }
@@ -419,54 +413,82 @@ TxOutputList
 TxCache::utxos(const AddressSet &addresses) const
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    graphBuild();
 
-    // Build a list of spends:
-    TxGraph graph(*this);
-
-    // Check each output against the list:
+    // The index only holds unspent outputs, so just look them up:
     TxOutputList out;
-    for (auto &row: txs_)
+    for (const auto &address: addresses)
     {
-        for (uint32_t i = 0; i < row.second.outputs.size(); ++i)
-        {
-            bc::hash_digest hash;
-            bc::decode_hash(hash, row.first);
+        const auto points = addressUtxos_.find(address);
+        if (addressUtxos_.end() == points)
+            continue;
 
-            bc::output_point point = {hash, i};
-            const auto &output = row.second.outputs[i];
-            bc::payment_address address;
-            const auto txid = row.first;
+        for (const auto &point: points->second)
+        {
+            const auto tx = find(point.hash);
+            if (!tx || tx->outputs.size() <= point.index)
+                continue;
 
-            // The output is interesting if it isn't spent and belongs to us:
-            if (!graph.isSpent(point) &&
-                    bc::extract(address, output.script) &&
-                    addresses.count(address.encoded()))
+            out.push_back(TxOutput
             {
-                out.push_back(TxOutput
-                {
-                    point, output.value,
-                    !graph.problems(row.first),
-                    isIncoming(row.second, txid, addresses)
-                });
-            }
+                point, tx->outputs[point.index].value,
+                !problems(point.hash),
+                isIncoming(*tx, point.hash, addresses)
+            });
         }
     }
 
     return out;
 }
 
+Status
+TxCache::checkUtxoIndex() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    graphBuild();
+
+    AddressIndex fresh;
+    utxoBuild(fresh);
+
+    for (const auto &row: fresh)
+    {
+        const auto i = addressUtxos_.find(row.first);
+        if (addressUtxos_.end() == i || i->second != row.second)
+            return ABC_ERROR(ABC_CC_Error, "Stale utxo index for " + row.first);
+    }
+    for (const auto &row: addressUtxos_)
+    {
+        if (!fresh.count(row.first))
+            return ABC_ERROR(ABC_CC_Error, "Extra utxo index for " + row.first);
+    }
+
+    return Status();
+}
+
 bool
 TxCache::drop(const std::string &txid, time_t now)
 {
     std::unique_lock<std::mutex> lock(mutex_);
 
     // Do not drop if it is confirmed or less than an hour old:
-    const auto &info = heights_[txid];
+    const auto hash = txidDecode(txid);
+    const auto &info = heights_[hash];
     if (info.height || now < info.firstSeen + 60*60)
         return false;
 
-    heights_.erase(txid);
-    txs_.erase(txid);
+    graphBuild();
+    const auto tx = find(hash);
+    if (tx)
+    {
+        graphRemove(hash, *tx);
+        utxoRemove(hash, *tx);
+    }
+    invalidate(hash);
+
+    heights_.erase(hash);
+    erase(hash);
+
+    log_.appendDrop(hash);
     return true;
 }
 
@@ -476,10 +498,17 @@ TxCache::insert(const bc::transaction_type &tx)
     std::unique_lock<std::mutex> lock(mutex_);
 
     // Do not stomp existing tx's:
-    auto txid = bc::encode_hash(bc::hash_transaction(tx));
-    if (txs_.find(txid) == txs_.end())
+    const auto hash = bc::hash_transaction(tx);
+    if (txs_.find(hash) == txs_.end())
     {
-        txs_[txid] = tx;
+        graphBuild();
+        txs_[hash].tx = std::make_shared<bc::transaction_type>(tx);
+        graphAdd(hash, tx);
+        utxoAdd(hash, tx);
+
+        bc::data_chunk rawTx(satoshi_raw_size(tx));
+        bc::satoshi_save(tx, rawTx.begin());
+        log_.appendTx(hash, rawTx);
         return true;
     }
 
@@ -491,15 +520,30 @@ TxCache::confirmed(const std::string &txid, size_t height, time_t now)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto &info = heights_[txid];
+    bc::hash_digest hash;
+    if (!bc::decode_hash(hash, txid))
+        return;
+
+    auto &info = heights_[hash];
+    const auto old = info;
     info.height = height;
     blocks_.headerNeededAdd(height);
     if (0 == info.firstSeen)
         info.firstSeen = now;
+
+    // Confirmation makes a transaction and its descendants safe:
+    if (old.height != info.height)
+        invalidate(hash);
+
+    // The servers report the same heights over and over,
+    // so only log actual changes:
+    if (old.height != info.height || old.firstSeen != info.firstSeen)
+        log_.appendHeight(hash, info.height, info.firstSeen);
 }
 
 bool
-TxCache::isIncoming(const bc::transaction_type &tx, const std::string &txid,
+TxCache::isIncoming(const bc::transaction_type &tx,
+                    const bc::hash_digest &txid,
                     const AddressSet &addresses) const
 {
     // Confirmed transactions are no longer incoming:
@@ -517,8 +561,340 @@ TxCache::isIncoming(const bc::transaction_type &tx, const std::string &txid,
     return false;
 }
 
+void
+TxCache::graphReset()
+{
+    graphBuilt_ = false;
+    spends_.clear();
+    children_.clear();
+    problems_.clear();
+    infos_.clear();
+    addressUtxos_.clear();
+}
+
+void
+TxCache::graphBuild() const
+{
+    if (graphBuilt_)
+        return;
+    graphBuilt_ = true;
+
+    // Outputs can only be checked for spends once the whole graph exists,
+    // so collect them during the same pass rather than decoding again:
+    std::vector<std::pair<std::string, bc::output_point>> outputs;
+    for (const auto &row: txs_)
+    {
+        const auto tx = decode(row.first, row.second, false);
+        if (!tx)
+            continue;
+
+        for (const auto &input: tx->inputs)
+        {
+            spends_[input.previous_output].insert(row.first);
+            children_[input.previous_output.hash].insert(row.first);
+        }
+
+        for (uint32_t i = 0; i < tx->outputs.size(); ++i)
+        {
+            bc::payment_address address;
+            if (bc::extract(address, tx->outputs[i].script))
+                outputs.push_back(std::make_pair(address.encoded(),
+                                                 bc::output_point{row.first, i}));
+        }
+    }
+
+    for (const auto &output: outputs)
+        if (!spends_.count(output.second))
+            addressUtxos_[output.first].insert(output.second);
+}
+
+void
+TxCache::graphAdd(const bc::hash_digest &txid,
+                  const bc::transaction_type &tx)
+{
+    for (const auto &input: tx.inputs)
+    {
+        auto &spenders = spends_[input.previous_output];
+        spenders.insert(txid);
+        children_[input.previous_output.hash].insert(txid);
+
+        // Everybody spending this output is now double-spent:
+        if (1 < spenders.size())
+            for (const auto &spender: spenders)
+                invalidate(spender);
+    }
+
+    // Our descendants may have been treating us as missing:
+    invalidate(txid);
+    infoInvalidate(txid);
+}
+
+void
+TxCache::graphRemove(const bc::hash_digest &txid,
+                     const bc::transaction_type &tx)
+{
+    for (const auto &input: tx.inputs)
+    {
+        auto children = children_.find(input.previous_output.hash);
+        if (children_.end() != children)
+        {
+            children->second.erase(txid);
+            if (children->second.empty())
+                children_.erase(children);
+        }
+
+        // The other spenders may no longer be double-spent:
+        auto spenders = spends_.find(input.previous_output);
+        if (spends_.end() != spenders)
+        {
+            spenders->second.erase(txid);
+            for (const auto &spender: spenders->second)
+                invalidate(spender);
+            if (spenders->second.empty())
+                spends_.erase(spenders);
+        }
+    }
+
+    invalidate(txid);
+    infoInvalidate(txid);
+}
+
+void
+TxCache::utxoBuild(AddressIndex &result) const
+{
+    for (const auto &row: txs_)
+    {
+        const auto tx = decode(row.first, row.second, false);
+        if (!tx)
+            continue;
+
+        for (uint32_t i = 0; i < tx->outputs.size(); ++i)
+        {
+            bc::output_point point = {row.first, i};
+            bc::payment_address address;
+            if (!spends_.count(point) &&
+                    bc::extract(address, tx->outputs[i].script))
+                result[address.encoded()].insert(point);
+        }
+    }
+}
+
+void
+TxCache::utxoAdd(const bc::hash_digest &txid, const bc::transaction_type &tx)
+{
+    // Our outputs might already have spends, if those arrived first:
+    for (uint32_t i = 0; i < tx.outputs.size(); ++i)
+    {
+        bc::output_point point = {txid, i};
+        bc::payment_address address;
+        if (!spends_.count(point) &&
+                bc::extract(address, tx.outputs[i].script))
+            addressUtxos_[address.encoded()].insert(point);
+    }
+
+    for (const auto &input: tx.inputs)
+    {
+        std::string address;
+        if (!pointAddress(address, input.previous_output))
+            continue;
+
+        auto points = addressUtxos_.find(address);
+        if (addressUtxos_.end() != points)
+        {
+            points->second.erase(input.previous_output);
+            if (points->second.empty())
+                addressUtxos_.erase(points);
+        }
+    }
+}
+
+void
+TxCache::utxoRemove(const bc::hash_digest &txid,
+                    const bc::transaction_type &tx)
+{
+    for (uint32_t i = 0; i < tx.outputs.size(); ++i)
+    {
+        bc::output_point point = {txid, i};
+        bc::payment_address address;
+        if (!bc::extract(address, tx.outputs[i].script))
+            continue;
+
+        auto points = addressUtxos_.find(address.encoded());
+        if (addressUtxos_.end() != points)
+        {
+            points->second.erase(point);
+            if (points->second.empty())
+                addressUtxos_.erase(points);
+        }
+    }
+
+    // Outputs with no other spenders become unspent again:
+    for (const auto &input: tx.inputs)
+    {
+        std::string address;
+        if (!spends_.count(input.previous_output) &&
+                pointAddress(address, input.previous_output))
+            addressUtxos_[address].insert(input.previous_output);
+    }
+}
+
+bool
+TxCache::pointAddress(std::string &result, const bc::point_type &point) const
+{
+    const auto tx = find(point.hash);
+    if (!tx || tx->outputs.size() <= point.index)
+        return false;
+
+    bc::payment_address address;
+    if (!bc::extract(address, tx->outputs[point.index].script))
+        return false;
+
+    result = address.encoded();
+    return true;
+}
+
+void
+TxCache::invalidate(const bc::hash_digest &txid)
+{
+    // Results are only ever computed after their ancestors' results,
+    // so if this one is gone, so are its descendants':
+    auto i = problems_.find(txid);
+    if (problems_.end() == i)
+        return;
+    problems_.erase(i);
+
+    const auto children = children_.find(txid);
+    if (children_.end() != children)
+        for (const auto &child: children->second)
+            invalidate(child);
+}
+
+unsigned
+TxCache::problems(const bc::hash_digest &txid) const
+{
+    // Just use the previous result if we have been here before:
+    auto pi = problems_.find(txid);
+    if (problems_.end() != pi)
+        return pi->second;
+
+    // We have to assume missing transactions are safe:
+    const auto tx = find(txid);
+    if (!tx)
+        return (problems_[txid] = 0);
+
+    // Confirmed transactions are also safe:
+    if (txidHeight(txid))
+        return (problems_[txid] = 0);
+
+    // Check for the opt-in replace-by-fee flag:
+    unsigned out = 0;
+    if (isReplaceByFee(*tx))
+        out |= replaceByFee;
+
+    // Recursively check all the inputs:
+    for (const auto &input: tx->inputs)
+    {
+        out |= problems(input.previous_output.hash);
+        const auto spenders = spends_.find(input.previous_output);
+        if (spends_.end() != spenders && 1 < spenders->second.size())
+            out |= doubleSpent;
+    }
+    return (problems_[txid] = out);
+}
+
+void
+TxCache::rewriteLog()
+{
+    log_.rewrite();
+
+    for (const auto &row: txs_)
+    {
+        const auto &hash = row.first;
+
+        // Raw transactions can go straight back out without a round-trip:
+        if (!row.second.raw.empty())
+        {
+            log_.appendTx(hash, row.second.raw);
+            continue;
+        }
+
+        bc::data_chunk rawTx(satoshi_raw_size(*row.second.tx));
+        bc::satoshi_save(*row.second.tx, rawTx.begin());
+        log_.appendTx(hash, rawTx);
+    }
+
+    for (const auto &height: heights_)
+        log_.appendHeight(height.first, height.second.height,
+                          height.second.firstSeen);
+}
+
+TxCache::TxPtr
+TxCache::find(const bc::hash_digest &txid) const
+{
+    const auto i = txs_.find(txid);
+    if (txs_.end() == i)
+        return TxPtr();
+    return decode(i->first, i->second);
+}
+
+TxCache::TxPtr
+TxCache::decode(const bc::hash_digest &txid, const TxRow &row,
+                bool remember) const
+{
+    // Rows without raw data are always decoded:
+    if (row.tx)
+    {
+        if (remember && !row.raw.empty())
+            recent_.splice(recent_.begin(), recent_, row.recent);
+        return row.tx;
+    }
+
+    auto tx = std::make_shared<bc::transaction_type>();
+    if (!decodeTx(*tx, row.raw).log())
+        return TxPtr();
+    if (!remember)
+        return tx;
+
+    row.tx = tx;
+    row.recent = recent_.insert(recent_.begin(), txid);
+
+    // Evict the least-recently-used transaction:
+    if (recentLimit < recent_.size())
+    {
+        const auto i = txs_.find(recent_.back());
+        if (txs_.end() != i)
+            i->second.tx.reset();
+        recent_.pop_back();
+    }
+    return tx;
+}
+
+TxCache::TxPtr
+TxCache::findValid(const bc::hash_digest &txid)
+{
+    const auto tx = find(txid);
+    // Undecodable rows never made it into the spend graph,
+    // so removing them leaves the graph consistent:
+    if (!tx)
+        erase(txid);
+    return tx;
+}
+
+void
+TxCache::erase(const bc::hash_digest &txid)
+{
+    const auto i = txs_.find(txid);
+    if (txs_.end() == i)
+        return;
+
+    if (!i->second.raw.empty() && i->second.tx)
+        recent_.erase(i->second.recent);
+    txs_.erase(i);
+    infos_.erase(txid);
+}
+
 size_t
-TxCache::txidHeight(const std::string &txid) const
+TxCache::txidHeight(const bc::hash_digest &txid) const
 {
     const auto i = heights_.find(txid);
     if (heights_.end() == i)
@@ -8,13 +8,55 @@
 #ifndef ABCD_BITCOIN_CACHE_TX_CACHE_HPP
 #define ABCD_BITCOIN_CACHE_TX_CACHE_HPP
 
+#include "TxLog.hpp"
 #include "../Typedefs.hpp"
 #include <bitcoin/bitcoin.hpp>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace std {
+
+/**
+ * Allows `bc::point_type` to be used with the unordered containers.
+ */
+template<> struct hash<bc::point_type>
+{
+    typedef bc::point_type argument_type;
+    typedef std::size_t result_type;
+
+    result_type
+    operator()(argument_type const &p) const
+    {
+        auto h = libbitcoin::from_little_endian_unsafe<result_type>(
+                     p.hash.begin());
+        return h ^ p.index;
+    }
+};
+
+} // namespace std
 
 namespace abcd {
 
+/**
+ * Hashes a `bc::hash_digest` for use with the unordered containers.
+ * The digest is already uniformly distributed,
+ * so the leading bytes make a perfectly good hash.
+ */
+struct DigestHash
+{
+    std::size_t
+    operator()(const bc::hash_digest &h) const
+    {
+        return libbitcoin::from_little_endian_unsafe<std::size_t>(h.begin());
+    }
+};
+
+typedef std::unordered_set<bc::hash_digest, DigestHash> DigestSet;
+typedef std::unordered_set<bc::point_type> PointSet;
+
 class BlockCache;
 class JsonObject;
 
@@ -84,7 +126,11 @@ class TxCache
 public:
     // Lifetime -----------------------------------------------------------
 
-    TxCache(BlockCache &blockCache);
+    /**
+     * @param path The binary cache file.
+     * Leave this blank to keep the cache in memory only.
+     */
+    TxCache(BlockCache &blockCache, const std::string &path="");
 
     /**
      * Clears the database for debugging purposes.
@@ -92,17 +138,27 @@ public:
     void
     clear();
 
+    /**
+     * Reads the database contents from the binary cache file.
+     */
+    Status
+    load();
+
     /**
      * Reads the database contents from the provided cache JSON object.
+     * Older versions of the software stored the transactions here,
+     * so this migrates them into the binary cache file.
      */
     Status
-    load(JsonObject &json);
+    loadJson(JsonObject &json);
 
     /**
-     * Saves the database contents to the provided cache JSON object.
+     * Writes any changes out to the binary cache file.
+     * This normally appends to the file,
+     * but will occasionally rewrite it to drop stale records.
      */
     Status
-    save(JsonObject &json);
+    save();
 
     // Queries ------------------------------------------------------------
 
@@ -129,7 +185,7 @@ public:
      * are missing from the cache.
      */
     bool
-    missing(const std::string &txid) const;
+    missing(const std::string &txid);
 
     /**
      * Verifies that the given transactions are present in the cache
@@ -137,7 +193,7 @@ public:
      * @return A list of needed txids.
      */
     TxidSet
-    missingTxids(const TxidSet &txids) const;
+    missingTxids(const TxidSet &txids);
 
     /**
      * Looks up a transaction and returns its confirmation & safety state.
@@ -158,6 +214,13 @@ public:
     TxOutputList
     utxos(const AddressSet &addresses) const;
 
+    /**
+     * Rebuilds the address index from scratch and compares it
+     * with the incrementally-maintained one, for testing purposes.
+     */
+    Status
+    checkUtxoIndex() const;
+
     // Updates ------------------------------------------------------------
 
     /**
@@ -182,37 +245,209 @@ public:
     confirmed(const std::string &txid, size_t height, time_t now=time(nullptr));
 
 private:
-    friend class TxGraph;
-
     struct HeightInfo
     {
         size_t height = 0;
         time_t firstSeen = 0;
     };
 
+    typedef std::shared_ptr<const bc::transaction_type> TxPtr;
+
+    /**
+     * A transaction in the database.
+     * Transactions loaded from disk stay in their raw form until needed,
+     * and are then decoded into a bounded most-recently-used list.
+     * Transactions that arrive over the network have no raw form yet,
+     * so they stay decoded.
+     */
+    struct TxRow
+    {
+        DataSlice raw;
+        mutable TxPtr tx;
+        mutable std::list<bc::hash_digest>::iterator recent;
+    };
+
     mutable std::mutex mutex_;
-    std::map<std::string, bc::transaction_type> txs_;
-    std::map<std::string, HeightInfo> heights_;
+    // Everything is keyed by binary txid, with hex only at the API boundary:
+    std::unordered_map<bc::hash_digest, TxRow, DigestHash> txs_;
+    std::unordered_map<bc::hash_digest, HeightInfo, DigestHash> heights_;
     BlockCache &blocks_;
 
+    // Decoded raw transactions, most recently used first:
+    mutable std::list<bc::hash_digest> recent_;
+
+    // The spend graph, which is built on first use after a load,
+    // and then stays current as transactions come and go:
+    mutable bool graphBuilt_ = false;
+    mutable std::unordered_map<bc::point_type, DigestSet> spends_;
+    mutable std::unordered_map<bc::hash_digest, DigestSet, DigestHash> children_;
+    mutable std::unordered_map<bc::hash_digest, unsigned, DigestHash> problems_;
+
+    // Input & output information, which only changes with the inputs:
+    mutable std::unordered_map<bc::hash_digest, TxInfo, DigestHash> infos_;
+
+    // Unspent outputs for each address:
+    typedef std::unordered_map<std::string, PointSet> AddressIndex;
+    mutable AddressIndex addressUtxos_;
+
+    // Disk storage (the file mutex keeps appends in order):
+    std::mutex fileMutex_;
+    TxLog log_;
+
+    /**
+     * Looks up a transaction, decoding it if necessary.
+     * Should be called with the mutex held.
+     * @return The transaction, or a null pointer if it is missing.
+     */
+    TxPtr
+    find(const bc::hash_digest &txid) const;
+
+    /**
+     * Decodes a transaction row.
+     * Should be called with the mutex held.
+     * @param remember false to skip the most-recently-used list,
+     * which keeps full-database scans from evicting useful entries.
+     */
+    TxPtr
+    decode(const bc::hash_digest &txid, const TxRow &row,
+           bool remember=true) const;
+
+    /**
+     * Looks up a transaction, dropping its row if it will not decode,
+     * so the corrupt copy gets fetched again like a missing one.
+     * Should be called with the mutex held.
+     * @return The transaction, or a null pointer if it is missing.
+     */
+    TxPtr
+    findValid(const bc::hash_digest &txid);
+
+    /**
+     * Removes a transaction row, along with any decoded copy.
+     * Should be called with the mutex held.
+     */
+    void
+    erase(const bc::hash_digest &txid);
+
+    /**
+     * Forgets the spend graph, address index, and derived results,
+     * leaving `graphBuild` to reconstruct them when next needed.
+     * Should be called with the mutex held.
+     */
+    void
+    graphReset();
+
+    /**
+     * Builds the spend graph and address index if they are missing,
+     * decoding each transaction only once.
+     * Should be called with the mutex held.
+     */
+    void
+    graphBuild() const;
+
+    /**
+     * Adds a transaction's spends to the graph,
+     * invalidating any problem flags that depend on it.
+     * Should be called with the mutex held.
+     */
+    void
+    graphAdd(const bc::hash_digest &txid, const bc::transaction_type &tx);
+
+    /**
+     * Removes a transaction's spends from the graph,
+     * invalidating any problem flags that depend on it.
+     * Should be called with the mutex held.
+     */
+    void
+    graphRemove(const bc::hash_digest &txid, const bc::transaction_type &tx);
+
+    /**
+     * Builds an address index from scratch, using the current spend graph.
+     * This is only for checking the incremental index.
+     * Should be called with the mutex held.
+     */
+    void
+    utxoBuild(AddressIndex &result) const;
+
+    /**
+     * Adds a transaction's outputs to the address index,
+     * and removes the outputs it spends.
+     * Should be called with the mutex held, after `graphAdd`.
+     */
+    void
+    utxoAdd(const bc::hash_digest &txid, const bc::transaction_type &tx);
+
+    /**
+     * Removes a transaction's outputs from the address index,
+     * and restores the outputs it used to spend.
+     * Should be called with the mutex held, after `graphRemove`.
+     */
+    void
+    utxoRemove(const bc::hash_digest &txid, const bc::transaction_type &tx);
+
+    /**
+     * Looks up the address that owns an output, if any.
+     * Should be called with the mutex held.
+     */
+    bool
+    pointAddress(std::string &result, const bc::point_type &point) const;
+
+    /**
+     * Forgets the problem flags for a transaction and its descendants.
+     * Should be called with the mutex held.
+     */
+    void
+    invalidate(const bc::hash_digest &txid);
+
+    /**
+     * Recursively checks the transaction graph for problems,
+     * re-using earlier results where possible.
+     * Should be called with the mutex held.
+     * @return A bitfield containing problem flags.
+     */
+    unsigned
+    problems(const bc::hash_digest &txid) const;
+
+    /**
+     * Replaces the log contents with the current database contents.
+     * Should be called with the mutex held.
+     */
+    void
+    rewriteLog();
+
     /**
      * Same as `txInfo`, but should be called with the mutex held.
      */
     Status
     infoInternal(TxInfo &result, const bc::transaction_type &tx) const;
 
+    /**
+     * Looks up a transaction's input & output information,
+     * re-using the earlier result if there is one.
+     * Should be called with the mutex held.
+     */
+    Status
+    infoCached(TxInfo &result, const bc::hash_digest &txid) const;
+
+    /**
+     * Forgets the input & output information for a transaction
+     * and the transactions that spend it.
+     * Should be called with the mutex held.
+     */
+    void
+    infoInvalidate(const bc::hash_digest &txid);
+
     /**
      * Returns true if the transaction has incoming non-change funds.
      */
     bool
-    isIncoming(const bc::transaction_type &tx, const std::string &txid,
+    isIncoming(const bc::transaction_type &tx, const bc::hash_digest &txid,
                const AddressSet &addresses) const;
 
     /**
      * Returns a transaction's height, or zero if it is unconfirmed.
      */
     size_t
-    txidHeight(const std::string &txid) const;
+    txidHeight(const bc::hash_digest &txid) const;
 };
 
 } // namespace abcd
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "TxLog.hpp"
+#include "../../util/Debug.hpp"
+#include "../../util/FileIO.hpp"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace abcd {
+
+constexpr uint32_t logMagic = 0x7843a1b7;
+constexpr uint32_t logVersion = 1;
+constexpr size_t headerSize = 8;
+
+// A rewrite is worthwhile once most of the file is stale:
+constexpr size_t staleRatio = 2;
+constexpr size_t staleSlack = 256;
+
+enum RecordType: uint8_t
+{
+    recordTx = 1,
+    recordHeight = 2,
+    recordDrop = 3
+};
+
+/**
+ * Reads a fixed-size integer, advancing the pointer.
+ * The caller must already have checked the length.
+ */
+template<typename T> static T
+readInt(const uint8_t *&p)
+{
+    const auto out = bc::from_little_endian_unsafe<T>(p);
+    p += sizeof(T);
+    return out;
+}
+
+static bc::hash_digest
+readHash(const uint8_t *&p)
+{
+    bc::hash_digest out;
+    std::copy(p, p + out.size(), out.begin());
+    p += out.size();
+    return out;
+}
+
+TxLog::~TxLog()
+{
+    unmap();
+}
+
+TxLog::TxLog(const std::string &path):
+    path_(path)
+{
+}
+
+Status
+TxLog::load(const TxCallback &onTx, const HeightCallback &onHeight,
+            const DropCallback &onDrop)
+{
+    pending_.clear();
+    records_ = 0;
+    rewrite_ = true;
+
+    ABC_CHECK(map());
+
+    const uint8_t *p = map_;
+    const uint8_t *end = map_ + mapSize_;
+    if (end - p < static_cast<ptrdiff_t>(headerSize) ||
+            logMagic != readInt<uint32_t>(p))
+        return ABC_ERROR(ABC_CC_ParseError, "Unknown transaction cache header");
+    if (logVersion != readInt<uint32_t>(p))
+        return ABC_ERROR(ABC_CC_ParseError, "Unknown transaction cache version");
+
+    const auto left = [&p, end]()
+    {
+        return static_cast<size_t>(end - p);
+    };
+
+    // A crash during an append can leave a partial record at the end.
+    // The complete records before it are still good,
+    // but the file needs a rewrite before we append anything else:
+    bool damaged = false;
+    while (p < end && !damaged)
+    {
+        const uint8_t type = *p++;
+        if (left() < std::tuple_size<bc::hash_digest>::value)
+        {
+            damaged = true;
+            break;
+        }
+        const auto txid = readHash(p);
+
+        switch (type)
+        {
+        case recordTx:
+        {
+            if (left() < 4)
+            {
+                damaged = true;
+                break;
+            }
+            const auto size = readInt<uint32_t>(p);
+            if (left() < size)
+            {
+                damaged = true;
+                break;
+            }
+            onTx(txid, DataSlice(p, p + size));
+            p += size;
+            break;
+        }
+
+        case recordHeight:
+        {
+            if (left() < 16)
+            {
+                damaged = true;
+                break;
+            }
+            const auto height = readInt<uint64_t>(p);
+            const auto firstSeen = readInt<uint64_t>(p);
+            onHeight(txid, height, firstSeen);
+            break;
+        }
+
+        case recordDrop:
+            onDrop(txid);
+            break;
+
+        default:
+            damaged = true;
+            break;
+        }
+
+        if (!damaged)
+            ++records_;
+    }
+
+    if (damaged)
+        ABC_DebugLog("Transaction cache %s is damaged", path_.c_str());
+    rewrite_ = damaged;
+    return Status();
+}
+
+bool
+TxLog::stale(size_t live) const
+{
+    return rewrite_ || staleRatio * live + staleSlack < records_;
+}
+
+void
+TxLog::rewrite()
+{
+    pending_.clear();
+    records_ = 0;
+    rewrite_ = true;
+}
+
+void
+TxLog::appendTx(const bc::hash_digest &txid, DataSlice rawTx)
+{
+    const auto data = buildData(
+    {
+        bc::to_byte(recordTx), txid,
+        bc::to_little_endian<uint32_t>(rawTx.size()), rawTx
+    });
+    pending_.insert(pending_.end(), data.begin(), data.end());
+    ++records_;
+}
+
+void
+TxLog::appendHeight(const bc::hash_digest &txid, size_t height,
+                    time_t firstSeen)
+{
+    const auto data = buildData(
+    {
+        bc::to_byte(recordHeight), txid,
+        bc::to_little_endian<uint64_t>(height),
+        bc::to_little_endian<uint64_t>(firstSeen)
+    });
+    pending_.insert(pending_.end(), data.begin(), data.end());
+    ++records_;
+}
+
+void
+TxLog::appendDrop(const bc::hash_digest &txid)
+{
+    const auto data = buildData({bc::to_byte(recordDrop), txid});
+    pending_.insert(pending_.end(), data.begin(), data.end());
+    ++records_;
+}
+
+TxLog::Batch
+TxLog::detach()
+{
+    Batch out;
+    out.data = std::move(pending_);
+    out.rewrite = rewrite_;
+
+    pending_.clear();
+    rewrite_ = false;
+    return out;
+}
+
+Status
+TxLog::write(const Batch &batch) const
+{
+    if (path_.empty())
+        return Status();
+
+    if (batch.rewrite)
+    {
+        const auto data = buildData(
+        {
+            bc::to_little_endian<uint32_t>(logMagic),
+            bc::to_little_endian<uint32_t>(logVersion),
+            batch.data
+        });
+        ABC_CHECK(fileSave(data, path_));
+        return Status();
+    }
+
+    if (batch.data.empty())
+        return Status();
+
+    FILE *fp = fopen(path_.c_str(), "ab");
+    if (!fp)
+        return ABC_ERROR(ABC_CC_FileOpenError,
+                         "Cannot open " + path_ + " for appending");
+
+    if (1 != fwrite(batch.data.data(), batch.data.size(), 1, fp))
+    {
+        fclose(fp);
+        return ABC_ERROR(ABC_CC_FileWriteError, "Cannot append to " + path_);
+    }
+    if (fclose(fp))
+        return ABC_ERROR(ABC_CC_FileWriteError, "Cannot append to " + path_);
+
+    return Status();
+}
+
+void
+TxLog::writeFailed()
+{
+    rewrite_ = true;
+}
+
+Status
+TxLog::map()
+{
+    unmap();
+
+    int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0)
+        return ABC_ERROR(ABC_CC_FileOpenError,
+                         "Cannot open " + path_ + " for reading");
+
+    struct stat statInfo;
+    if (fstat(fd, &statInfo) || !statInfo.st_size)
+    {
+        close(fd);
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot read " + path_);
+    }
+
+    void *map = mmap(nullptr, statInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map)
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot map " + path_);
+
+    map_ = static_cast<const uint8_t *>(map);
+    mapSize_ = statInfo.st_size;
+    return Status();
+}
+
+void
+TxLog::unmap()
+{
+    if (map_)
+        munmap(const_cast<uint8_t *>(map_), mapSize_);
+    map_ = nullptr;
+    mapSize_ = 0;
+}
+
+} // namespace abcd
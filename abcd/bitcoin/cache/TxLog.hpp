@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#ifndef ABCD_BITCOIN_CACHE_TX_LOG_HPP
+#define ABCD_BITCOIN_CACHE_TX_LOG_HPP
+
+#include "../../util/Data.hpp"
+#include "../../util/Status.hpp"
+#include <bitcoin/bitcoin.hpp>
+#include <time.h>
+#include <functional>
+
+namespace abcd {
+
+/**
+ * The on-disk format for the transaction cache.
+ *
+ * The file is a versioned header followed by an append-only list of
+ * records, each of which either adds a raw transaction,
+ * updates a transaction's height, or drops a transaction.
+ * Later records override earlier ones, so the whole file can be
+ * replayed in a single sequential read.
+ *
+ * Once the file accumulates too many stale records,
+ * the owner should call `rewrite` and re-append its live contents,
+ * which replaces the file atomically on the next `write`.
+ *
+ * The file is memory-mapped rather than read,
+ * so the raw transactions can stay on disk until somebody needs them.
+ * Appends and rewrites never modify the mapped bytes in place,
+ * so the mapping stays valid until the next `load`.
+ *
+ * This class is not thread-safe, so the owner must provide locking.
+ */
+class TxLog
+{
+public:
+    typedef std::function<void (const bc::hash_digest &txid, DataSlice rawTx)>
+    TxCallback;
+    typedef std::function<void (const bc::hash_digest &txid,
+                                size_t height, time_t firstSeen)>
+    HeightCallback;
+    typedef std::function<void (const bc::hash_digest &txid)> DropCallback;
+
+    /**
+     * A group of records waiting to go out to disk.
+     */
+    struct Batch
+    {
+        DataChunk data;
+        bool rewrite = false;
+    };
+
+    ~TxLog();
+
+    /**
+     * Prepares a log for the given file.
+     * An empty path gives a memory-only log, which never touches the disk.
+     */
+    TxLog(const std::string &path);
+
+    TxLog(const TxLog &copy) = delete;
+    TxLog &operator=(const TxLog &copy) = delete;
+
+    /**
+     * Maps the file and replays its records in order.
+     * The slices passed to `onTx` point into the mapping,
+     * and remain valid until the next `load` or until the log is destroyed.
+     * If the file is missing or damaged, the log will be rewritten
+     * from scratch on the next `write`.
+     */
+    Status
+    load(const TxCallback &onTx, const HeightCallback &onHeight,
+         const DropCallback &onDrop);
+
+    /**
+     * Returns true if the log has accumulated enough stale records
+     * to justify a rewrite.
+     * @param live The number of records needed to describe the cache.
+     */
+    bool
+    stale(size_t live) const;
+
+    /**
+     * Discards the pending records and file contents.
+     * The caller should append its entire live state after this.
+     */
+    void
+    rewrite();
+
+    // Records -------------------------------------------------------------
+
+    void
+    appendTx(const bc::hash_digest &txid, DataSlice rawTx);
+
+    void
+    appendHeight(const bc::hash_digest &txid, size_t height, time_t firstSeen);
+
+    void
+    appendDrop(const bc::hash_digest &txid);
+
+    // Disk access ---------------------------------------------------------
+
+    /**
+     * Takes the pending records, leaving the log ready for more.
+     * The batch can then be written without holding the owner's lock.
+     */
+    Batch
+    detach();
+
+    /**
+     * Puts a detached batch on disk, either by appending it to the file
+     * or by atomically replacing the file if the batch is a rewrite.
+     * The caller must ensure that batches are written in the same order
+     * they were detached.
+     */
+    Status
+    write(const Batch &batch) const;
+
+    /**
+     * Re-arms a rewrite after a batch fails to reach the disk,
+     * since the file no longer matches the owner's contents.
+     */
+    void
+    writeFailed();
+
+private:
+    const std::string path_;
+
+    // Read-only file mapping:
+    const uint8_t *map_ = nullptr;
+    size_t mapSize_ = 0;
+
+    DataChunk pending_;
+    size_t records_ = 0;
+    bool rewrite_ = true;
+
+    Status
+    map();
+
+    void
+    unmap();
+};
+
+} // namespace abcd
+
+#endif
@@ -48,6 +48,12 @@ public:
     virtual bool
     queueFull() = 0;
 
+    /**
+     * Returns the number of requests waiting for a reply.
+     */
+    virtual size_t
+    queueSize() = 0;
+
     /**
      * Begins watching for blockchain height changes.
      */
@@ -91,6 +91,12 @@ LibbitcoinConnection::queueFull()
     return 10 < queuedQueries_;
 }
 
+size_t
+LibbitcoinConnection::queueSize()
+{
+    return queuedQueries_;
+}
+
 void
 LibbitcoinConnection::heightSubscribe(const StatusCallback &onError,
                                       const HeightCallback &onReply)
@@ -36,6 +36,9 @@ public:
     bool
     queueFull() override;
 
+    size_t
+    queueSize() override;
+
     void
     heightSubscribe(const StatusCallback &onError,
                     const HeightCallback &onReply) override;
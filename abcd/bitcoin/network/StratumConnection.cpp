@@ -58,6 +58,11 @@ StratumConnection::~StratumConnection()
         i.second.onError(ABC_ERROR(ABC_CC_Error, "Connection closed"));
 }
 
+StratumConnection::StratumConnection(size_t window):
+    window_(window)
+{
+}
+
 void
 StratumConnection::version(const StatusCallback &onError,
                            const VersionHandler &onReply)
@@ -140,7 +145,7 @@ StratumConnection::connect(const std::string &rawUri)
     auto serverName = server.substr(0, last);
     auto serverPort = server.substr(last + 1, std::string::npos);
 
-    // Connect to the server:
+    // Start connecting to the server:
     ABC_CHECK(connection_.connect(serverName, atoi(serverPort.c_str())));
     lastKeepalive_ = std::chrono::steady_clock::now();
 
@@ -150,24 +155,39 @@ StratumConnection::connect(const std::string &rawUri)
 Status
 StratumConnection::wakeup(SleepTime &sleep)
 {
-    // Read any data available on the socket:
-    DataChunk buffer;
-    ABC_CHECK(connection_.read(buffer));
-    incoming_ += std::string(buffer.begin(), buffer.end());
+    // Finish connecting, if we haven't already:
+    if (!connection_.connected())
+    {
+        ABC_CHECK(connection_.connectWakeup(sleep));
+        if (!connection_.connected())
+            return Status();
+
+        // Time spent connecting doesn't count against the server:
+        ABC_DebugLog("%s: connected", uri_.c_str());
+        lastKeepalive_ = std::chrono::steady_clock::now();
+        lastProgress_ = lastKeepalive_;
+    }
 
-    // Extract any incoming messages:
-    while (true)
+    // Read any data available on the socket:
+    ABC_CHECK(connection_.read(incoming_));
+
+    // Process the complete messages in place,
+    // without re-scanning any partial message from last time:
+    const uint8_t *data = incoming_.data();
+    const uint8_t *end = data + incoming_.size();
+    const uint8_t *start = data;
+    const uint8_t *where = data + incomingScanned_;
+    while (end != (where = std::find(where, end, '\n')))
     {
-        // Find the newline:
-        auto where = std::find(incoming_.begin(), incoming_.end(), '\n');
-        if (incoming_.end() == where)
-            break;
-
-        // Extract and process the message:
-        ABC_CHECK(handleMessage(std::string(incoming_.begin(), where + 1)));
-        incoming_.erase(incoming_.begin(), where + 1);
+        ++where;
+        ABC_CHECK(handleMessage(DataSlice(start, where)));
+        start = where;
     }
 
+    // Keep the partial message for next time, shifting it down just once:
+    incoming_.erase(incoming_.begin(), incoming_.begin() + (start - data));
+    incomingScanned_ = incoming_.size();
+
     // We need to wake up every minute:
     auto now = std::chrono::steady_clock::now();
     if (lastKeepalive_ + keepaliveTime < now)
@@ -183,6 +203,7 @@ StratumConnection::wakeup(SleepTime &sleep)
     }
     sleep = std::chrono::duration_cast<SleepTime>(
                 lastKeepalive_ + keepaliveTime - now);
+    ABC_CHECK(flush());
 
     // Check the timeout:
     if (pending_.size())
@@ -196,16 +217,65 @@ StratumConnection::wakeup(SleepTime &sleep)
     return Status();
 }
 
+Status
+StratumConnection::flush()
+{
+    // Requests wait in the queue until we are connected:
+    if (outgoing_.empty() || !connection_.connected())
+        return Status();
+
+    const auto s = connection_.send(outgoing_);
+    outgoing_.clear();
+    ABC_CHECK(s);
+
+    return Status();
+}
+
 std::string
 StratumConnection::uri()
 {
     return uri_;
 }
 
+std::list<zmq_pollitem_t>
+StratumConnection::pollitems() const
+{
+    std::list<zmq_pollitem_t> out;
+    if (connection_.connected())
+    {
+        zmq_pollitem_t pollitem =
+        {
+            nullptr, connection_.pollfd(), ZMQ_POLLIN, 0
+        };
+        out.push_back(pollitem);
+    }
+    else
+    {
+        for (auto fd: connection_.connectingFds())
+        {
+            zmq_pollitem_t pollitem =
+            {
+                nullptr, fd, ZMQ_POLLOUT, 0
+            };
+            out.push_back(pollitem);
+        }
+    }
+    return out;
+}
+
 bool
 StratumConnection::queueFull()
 {
-    return 10 < pending_.size();
+    // New work should go to servers that can answer right away:
+    if (!connection_.connected())
+        return true;
+    return window_ <= pending_.size();
+}
+
+size_t
+StratumConnection::queueSize()
+{
+    return pending_.size();
 }
 
 void
@@ -382,20 +452,19 @@ StratumConnection::sendMessage(const std::string &method, JsonPtr params,
     query.methodSet(method);
     query.paramsSet(params);
 
-    auto s = connection_.send(query.encode(true) + '\n');
-    if (!s)
-        return onError(s);
+    // Send failures show up during the next flush,
+    // which takes down the connection along with the pending callbacks:
+    outgoing_ += query.encode(true) + '\n';
 
     // Start the timeout if this is the first message in the queue:
     if (pending_.empty())
         lastProgress_ = std::chrono::steady_clock::now();
 
-    // The message has been sent, so save the decoder:
     pending_[id] = Pending{ onError, decoder };
 }
 
 Status
-StratumConnection::handleMessage(const std::string &message)
+StratumConnection::handleMessage(DataSlice message)
 {
     ReplyJson json;
     ABC_CHECK(json.decode(message));
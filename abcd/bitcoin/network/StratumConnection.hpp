@@ -10,7 +10,9 @@
 
 #include "IBitcoinConnection.hpp"
 #include "TcpConnection.hpp"
+#include <zmq.h>
 #include <chrono>
+#include <list>
 #include <map>
 
 namespace abcd {
@@ -30,6 +32,13 @@ public:
 
     ~StratumConnection();
 
+    /**
+     * @param window The number of requests that can be in flight at once.
+     * Requests are pipelined, so a large window lets the server
+     * work through a big batch in a single round trip.
+     */
+    StratumConnection(size_t window=16);
+
     /**
      * Requests the server version.
      */
@@ -54,11 +63,19 @@ public:
     sendTx(const StatusCallback &onDone, DataSlice tx);
 
     /**
-     * Connects to the specified stratum server.
+     * Begins connecting to the specified stratum server.
+     * The connection finishes in the background as `wakeup` runs,
+     * and requests made before then are sent once it is ready.
      */
     Status
     connect(const std::string &uri);
 
+    /**
+     * Returns true once the server is ready to receive requests.
+     */
+    bool
+    connected() const { return connection_.connected(); }
+
     /**
      * Performs any pending work,
      * and returns the number of ms until the next time we need a wakeup.
@@ -67,9 +84,18 @@ public:
     wakeup(SleepTime &sleep);
 
     /**
-     * Obtains the socket that the main loop should sleep on.
+     * Writes any queued requests to the socket.
+     * Requests go out in one write per batch,
+     * so the caller should flush after scheduling a round of work.
+     */
+    Status
+    flush();
+
+    /**
+     * Obtains a list of sockets that the main loop should sleep on.
      */
-    int pollfd() const { return connection_.pollfd(); }
+    std::list<zmq_pollitem_t>
+    pollitems() const;
 
     // IBitcoinConnection interface:
     std::string
@@ -78,6 +104,9 @@ public:
     bool
     queueFull() override;
 
+    size_t
+    queueSize() override;
+
     void
     heightSubscribe(const StatusCallback &onError,
                     const HeightCallback &onReply) override;
@@ -111,9 +140,12 @@ private:
     // Socket:
     std::string uri_;
     TcpConnection connection_;
-    std::string incoming_;
+    DataChunk incoming_;
+    size_t incomingScanned_ = 0; // Bytes known to contain no newline
 
     // Sending:
+    const size_t window_;
+    std::string outgoing_;
     unsigned lastId = 0;
     struct Pending
     {
@@ -134,7 +166,7 @@ private:
     std::map<std::string, AddressUpdateCallback> addressCallbacks_;
 
     /**
-     * Sends a message and sets up the reply decoder.
+     * Queues a message and sets up the reply decoder.
      * If anything goes wrong (including errors returned by the decoder),
      * the error callback will be called.
      */
@@ -146,7 +178,7 @@ private:
      * Decodes and handles a complete message from the server.
      */
     Status
-    handleMessage(const std::string &message);
+    handleMessage(DataSlice message);
 };
 
 } // namespace abcd
@@ -9,92 +9,208 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
 
 namespace abcd {
 
-static int
-timeoutConnect(int sock, struct sockaddr *addr,
-               socklen_t addr_len, struct timeval *tv)
-{
-    fd_set fdset;
-    int flags = 0;
-    int so_error;
-    socklen_t len = sizeof(so_error);
-
-    if ((flags = fcntl(sock, F_GETFL, 0)) < 0)
-        return -1;
-
-    if (fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0)
-        return -1;
-
-    if (connect(sock, addr, addr_len) == 0)
-        goto exit;
+constexpr std::chrono::seconds resolveTimeout(10);
+constexpr std::chrono::milliseconds resolvePoll(50);
+constexpr std::chrono::seconds attemptTimeout(10);
+constexpr std::chrono::milliseconds attemptStagger(250);
 
-    FD_ZERO(&fdset);
-    FD_SET(sock, &fdset);
-
-    if (select(sock + 1, NULL, &fdset, NULL, tv) > 0)
-    {
-        getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_error, &len);
-        if (so_error == 0)
-            goto exit;
-    }
-    return -1;
+/**
+ * A DNS result, copied out of the `addrinfo` list.
+ */
+struct TcpConnection::Address
+{
+    int family;
+    int socktype;
+    int protocol;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+};
 
-exit:
-    if (fcntl(sock, F_SETFL, flags) < 0)
-        return -1;
-    return 0;
-}
+/**
+ * Results from the background DNS lookup.
+ * This is shared with the lookup thread,
+ * which can outlive the connection.
+ */
+struct TcpConnection::Resolver
+{
+    std::mutex mutex;
+    bool done = false;
+    bool failed = false;
+    std::list<Address> addresses;
+};
 
 TcpConnection::~TcpConnection()
 {
-    if (0 < fd_)
+    attemptsClose();
+    if (0 <= fd_)
         close(fd_);
 }
 
 TcpConnection::TcpConnection():
-    fd_(0)
+    fd_(-1)
 {
 }
 
 Status
 TcpConnection::connect(const std::string &hostname, unsigned port)
 {
-    // Do the DNS lookup:
-    struct addrinfo hints {};
-    struct addrinfo *list = nullptr;
-    hints.ai_family = AF_UNSPEC; // Allow IPv6 or IPv4
-    hints.ai_socktype = SOCK_STREAM; // TCP only
-    if (getaddrinfo(hostname.c_str(), std::to_string(port).c_str(), &hints, &list))
-        return ABC_ERROR(ABC_CC_ServerError, "Cannot look up " + hostname);
-
-    // Try the returned DNS entries until one connects:
-    for (struct addrinfo *p = list; p; ++p)
+    hostname_ = hostname;
+    resolveStart_ = Clock::now();
+
+    // Do the DNS lookup on its own thread, since it can block:
+    auto resolver = std::make_shared<Resolver>();
+    resolver_ = resolver;
+    const auto service = std::to_string(port);
+    std::thread([resolver, hostname, service]()
     {
-        fd_ = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (fd_ < 0)
+        struct addrinfo hints {};
+        struct addrinfo *list = nullptr;
+        hints.ai_family = AF_UNSPEC; // Allow IPv6 or IPv4
+        hints.ai_socktype = SOCK_STREAM; // TCP only
+        const bool failed = getaddrinfo(hostname.c_str(), service.c_str(),
+                                        &hints, &list);
+
+        // Alternate between address families, so a broken
+        // IPv6 or IPv4 route only delays us by one stagger:
+        std::list<Address> primary, secondary;
+        for (struct addrinfo *p = list; p; p = p->ai_next)
         {
+            Address address;
+            address.family = p->ai_family;
+            address.socktype = p->ai_socktype;
+            address.protocol = p->ai_protocol;
+            memcpy(&address.addr, p->ai_addr, p->ai_addrlen);
+            address.addrlen = p->ai_addrlen;
+
+            if (primary.empty() || primary.front().family == p->ai_family)
+                primary.push_back(address);
+            else
+                secondary.push_back(address);
+        }
+        if (list)
             freeaddrinfo(list);
-            return ABC_ERROR(ABC_CC_ServerError, "Cannot create socket to " + hostname);
+
+        std::list<Address> addresses;
+        while (!primary.empty() || !secondary.empty())
+        {
+            if (!primary.empty())
+            {
+                addresses.push_back(primary.front());
+                primary.pop_front();
+            }
+            if (!secondary.empty())
+            {
+                addresses.push_back(secondary.front());
+                secondary.pop_front();
+            }
         }
 
-        struct timeval sto;
-        sto.tv_sec = 10;
-        sto.tv_usec = 0;
-        if (0 == timeoutConnect(fd_, p->ai_addr, p->ai_addrlen, &sto))
-            break;
+        std::lock_guard<std::mutex> lock(resolver->mutex);
+        resolver->done = true;
+        resolver->failed = failed;
+        resolver->addresses = std::move(addresses);
+    }).detach();
 
-        close(fd_);
-        fd_ = 0;
+    return Status();
+}
+
+Status
+TcpConnection::connectWakeup(std::chrono::milliseconds &sleep)
+{
+    const auto now = Clock::now();
+    sleep = std::chrono::milliseconds(0);
+    if (connected())
+        return Status();
+
+    // Collect the DNS results:
+    if (resolver_)
+    {
+        std::lock_guard<std::mutex> lock(resolver_->mutex);
+        if (!resolver_->done)
+        {
+            if (resolveStart_ + resolveTimeout < now)
+                return ABC_ERROR(ABC_CC_ServerError, "Cannot look up " + hostname_);
+            sleep = resolvePoll;
+            return Status();
+        }
+        if (resolver_->failed)
+            return ABC_ERROR(ABC_CC_ServerError, "Cannot look up " + hostname_);
+
+        addresses_ = std::move(resolver_->addresses);
+        nextAttempt_ = now;
     }
-    freeaddrinfo(list);
+    resolver_.reset();
 
-    if (fd_ < 0)
-        return ABC_ERROR(ABC_CC_ServerError, "Cannot connect to " + hostname);
+    // Check the attempts in progress:
+    auto i = attempts_.begin();
+    while (attempts_.end() != i)
+    {
+        struct pollfd pfd = { i->fd, POLLOUT, 0 };
+        if (0 < poll(&pfd, 1, 0))
+        {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (0 == getsockopt(i->fd, SOL_SOCKET, SO_ERROR, &error, &len) &&
+                    !error)
+            {
+                // We have a winner, so go back to blocking mode:
+                const int fd = i->fd;
+                attempts_.erase(i);
+                attemptsClose();
+                addresses_.clear();
+
+                int flags = fcntl(fd, F_GETFL, 0);
+                if (flags < 0 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+                {
+                    close(fd);
+                    return ABC_ERROR(ABC_CC_ServerError,
+                                     "Cannot set up socket to " + hostname_);
+                }
+                fd_ = fd;
+                return Status();
+            }
+
+            close(i->fd);
+            i = attempts_.erase(i);
+        }
+        else if (i->start + attemptTimeout < now)
+        {
+            close(i->fd);
+            i = attempts_.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    // Dial another address if the others are slow or gone:
+    while (!addresses_.empty() && (attempts_.empty() || nextAttempt_ <= now))
+        attemptStart(now);
+
+    if (attempts_.empty())
+        return ABC_ERROR(ABC_CC_ServerError, "Cannot connect to " + hostname_);
+
+    // Wake up for the next stagger or timeout:
+    auto wake = nextAttempt_;
+    if (addresses_.empty())
+        wake = now + attemptTimeout;
+    for (const auto &attempt: attempts_)
+        wake = std::min(wake, attempt.start + attemptTimeout);
+    sleep = std::max(std::chrono::milliseconds(1),
+                     std::chrono::duration_cast<std::chrono::milliseconds>(
+                         wake - now));
 
     return Status();
 }
@@ -115,21 +231,72 @@ TcpConnection::send(DataSlice data)
 }
 
 Status
-TcpConnection::read(DataChunk &result)
+TcpConnection::read(DataChunk &buffer)
 {
-    unsigned char data[1024];
-    auto bytes = recv(fd_, data, sizeof(data), MSG_DONTWAIT);
-    if (bytes < 0)
+    constexpr size_t chunkSize = 4096;
+
+    // Receive straight into the buffer until the socket runs dry:
+    while (true)
     {
-        if (EAGAIN != errno && EWOULDBLOCK != errno)
-            return ABC_ERROR(ABC_CC_ServerError, "Cannot read from socket");
+        const auto start = buffer.size();
+        buffer.resize(start + chunkSize);
+        auto bytes = recv(fd_, buffer.data() + start, chunkSize, MSG_DONTWAIT);
+        if (bytes < 0)
+        {
+            buffer.resize(start);
+            if (EAGAIN != errno && EWOULDBLOCK != errno)
+                return ABC_ERROR(ABC_CC_ServerError, "Cannot read from socket");
+
+            // No data, but that's fine:
+            return Status();
+        }
 
-        // No data, but that's fine:
-        bytes = 0;
+        buffer.resize(start + bytes);
+        if (bytes < static_cast<ssize_t>(chunkSize))
+            return Status();
     }
+}
 
-    result = DataChunk(data, data + bytes);
-    return Status();
+std::vector<int>
+TcpConnection::connectingFds() const
+{
+    std::vector<int> out;
+    for (const auto &attempt: attempts_)
+        out.push_back(attempt.fd);
+    return out;
+}
+
+void
+TcpConnection::attemptStart(Clock::time_point now)
+{
+    const auto address = addresses_.front();
+    addresses_.pop_front();
+    nextAttempt_ = now + attemptStagger;
+
+    int fd = socket(address.family, address.socktype, address.protocol);
+    if (fd < 0)
+        return;
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        close(fd);
+        return;
+    }
+
+    if (0 == ::connect(fd, reinterpret_cast<const struct sockaddr *>(&address.addr),
+                       address.addrlen) || EINPROGRESS == errno)
+        attempts_.push_back(Attempt{fd, now});
+    else
+        close(fd);
+}
+
+void
+TcpConnection::attemptsClose()
+{
+    for (const auto &attempt: attempts_)
+        close(attempt.fd);
+    attempts_.clear();
 }
 
 } // namespace abcd
@@ -10,6 +10,10 @@
 
 #include "../../util/Status.hpp"
 #include "../../util/Data.hpp"
+#include <chrono>
+#include <list>
+#include <memory>
+#include <vector>
 
 namespace abcd {
 
@@ -20,11 +24,30 @@ public:
     TcpConnection();
 
     /**
-     * Connect to the specified server.
+     * Begins connecting to the specified server.
+     * The DNS lookup happens in the background,
+     * and `connectWakeup` drives the rest of the process.
      */
     Status
     connect(const std::string &hostname, unsigned port);
 
+    /**
+     * Advances a connection in progress.
+     * Once the DNS lookup finishes, this dials the addresses in parallel,
+     * starting a new one each time the previous one is slow to answer.
+     * The first address to connect wins.
+     * @param sleep The time until the next wakeup is needed.
+     * @return An error if every address has failed.
+     */
+    Status
+    connectWakeup(std::chrono::milliseconds &sleep);
+
+    /**
+     * Returns true once the connection is ready for use.
+     */
+    bool
+    connected() const { return 0 <= fd_; }
+
     /**
      * Send some data over the socket.
      */
@@ -32,18 +55,53 @@ public:
     send(DataSlice data);
 
     /**
-     * Read all pending data from the socket (might not produce anything).
+     * Read all pending data from the socket (might not produce anything),
+     * appending it to the end of the buffer.
      */
     Status
-    read(DataChunk &result);
+    read(DataChunk &buffer);
 
     /**
      * Obtains a list of sockets that the main loop should sleep on.
      */
     int pollfd() const { return fd_; }
 
+    /**
+     * Lists the sockets that are still trying to connect.
+     * The main loop should wait for these to become writable.
+     */
+    std::vector<int>
+    connectingFds() const;
+
 private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Address;
+    struct Resolver;
+    struct Attempt
+    {
+        int fd;
+        Clock::time_point start;
+    };
+
     int fd_;
+    std::string hostname_;
+
+    // Connection progress:
+    std::shared_ptr<Resolver> resolver_;
+    Clock::time_point resolveStart_;
+    std::list<Address> addresses_;
+    std::list<Attempt> attempts_;
+    Clock::time_point nextAttempt_;
+
+    /**
+     * Starts dialing the next address in the list.
+     */
+    void
+    attemptStart(Clock::time_point now);
+
+    void
+    attemptsClose();
 };
 
 } // namespace abcd
@@ -12,24 +12,58 @@
 #include "../../General.hpp"
 #include "../../util/Debug.hpp"
 #include <sys/time.h>
+#include <algorithm>
+#include <vector>
 
 namespace abcd {
 
 constexpr auto NUM_CONNECT_SERVERS = 5;
 constexpr auto MINIMUM_LIBBITCOIN_SERVERS = 1;
 constexpr auto MINIMUM_STRATUM_SERVERS = 4;
+constexpr auto STRATUM_WINDOW = 50;
+
+// Load balancing:
+constexpr double LATENCY_WEIGHT = 0.2; // Weight of each new reply time
+constexpr size_t LATENCY_SAMPLES = 32; // Reply times kept for percentiles
+constexpr double DEFAULT_LATENCY_MS = 500; // Guess for untested servers
+constexpr unsigned long long DEFAULT_HEDGE_MS = 2000;
+constexpr unsigned long long MINIMUM_HEDGE_MS = 250;
 
 TxUpdater::~TxUpdater()
 {
     disconnect();
 }
 
-TxUpdater::TxUpdater(Cache &cache, void *ctx):
-    cache_(cache),
+TxUpdater::TxUpdater(BlockCache &blocks, ServerCache &servers, void *ctx):
+    blocks_(blocks),
+    servers_(servers),
     ctx_(ctx)
 {
 }
 
+void
+TxUpdater::walletAdd(const std::string &id, std::shared_ptr<Cache> cache)
+{
+    WalletRow row;
+    row.cache = std::move(cache);
+    wallets_[id] = std::move(row);
+}
+
+void
+TxUpdater::walletRemove(const std::string &id)
+{
+    auto i = wallets_.find(id);
+    if (wallets_.end() == i)
+        return;
+
+    if (i->second.cacheDirty)
+        i->second.cache->save().log(); // Failure is fine
+    wallets_.erase(i);
+
+    for (auto &wip: wipTxids_)
+        wip.second.erase(id);
+}
+
 void
 TxUpdater::disconnect()
 {
@@ -52,12 +86,12 @@ TxUpdater::connect()
 
     // If we are out of fresh stratum servers, reload the list:
     if (stratumServers_.empty())
-        stratumServers_ = cache_.servers.getServers(ServerTypeStratum,
+        stratumServers_ = servers_.getServers(ServerTypeStratum,
                           MINIMUM_STRATUM_SERVERS * 2);
 
     // If we are out of fresh libbitcoin servers, reload the list:
     if (libbitcoinServers_.empty())
-        libbitcoinServers_ = cache_.servers.getServers(ServerTypeLibbitcoin,
+        libbitcoinServers_ = servers_.getServers(ServerTypeLibbitcoin,
                              MINIMUM_LIBBITCOIN_SERVERS * 2);
 
     for (int i = 0; i < libbitcoinServers_.size(); i++)
@@ -120,7 +154,7 @@ TxUpdater::connect()
             }
             else
             {
-                cache_.servers.serverScoreDown(*i);
+                servers_.serverScoreDown(*i);
             }
             untriedPrimary->erase(i);
         }
@@ -137,7 +171,7 @@ TxUpdater::connect()
             }
             else
             {
-                cache_.servers.serverScoreDown(*i);
+                servers_.serverScoreDown(*i);
             }
             untriedSecondary->erase(i);
         }
@@ -161,7 +195,7 @@ TxUpdater::wakeup()
                 failedServers_.insert(bc->uri());
             else
             {
-                cache_.servers.serverScoreUp(bc->uri(), 0);
+                servers_.serverScoreUp(bc->uri(), 0);
                 nextWakeup = bc::client::min_sleep(nextWakeup, sleep);
             }
         }
@@ -171,53 +205,60 @@ TxUpdater::wakeup()
             nextWakeup = bc::client::min_sleep(nextWakeup, lc->wakeup());
     }
 
-    // Fetch missing transactions:
-    time_t sleep;
-    const auto statuses = cache_.addresses.statuses(sleep);
-    nextWakeup = bc::client::min_sleep(nextWakeup, std::chrono::seconds(sleep));
-    for (const auto &status: statuses)
+    for (auto &wallet: wallets_)
     {
-        for (const auto &txid: status.missingTxids)
+        auto &cache = *wallet.second.cache;
+        subscribeWallet(wallet.second);
+
+        // Fetch missing transactions:
+        time_t sleep;
+        const auto statuses = cache.addresses.statuses(sleep);
+        nextWakeup = bc::client::min_sleep(nextWakeup,
+                                           std::chrono::seconds(sleep));
+        for (const auto &status: statuses)
         {
-            // Try to use the same server:
-            auto *bc = pickServer(addressServers_[status.address]);
-            if (!bc)
-                break;
+            for (const auto &txid: status.missingTxids)
+            {
+                // Try to use the same server:
+                auto *bc = pickServer(addressServers_[status.address]);
+                if (!bc)
+                    break;
 
-            fetchTx(txid, bc);
+                fetchTx(txid, wallet.first, bc);
+            }
         }
-    }
 
-    // Schedule new address work:
-    for (const auto &status: statuses)
-    {
-        if (status.dirty)
+        // Schedule new address work:
+        for (const auto &status: statuses)
         {
-            // Try to use the same server that made us dirty:
-            auto *bc = pickServer(addressServers_[status.address]);
-            if (!bc)
-                break;
+            if (status.dirty)
+            {
+                // Try to use the same server that made us dirty:
+                auto *bc = pickServer(addressServers_[status.address]);
+                if (!bc)
+                    break;
+
+                if (bc->addressSubscribed(status.address))
+                    fetchAddress(status.address, bc);
+                else
+                    subscribeAddress(status.address, bc);
+            }
+            else if (status.needsCheck && !wipSubscribes_.count(status.address))
+            {
+                // Try to use a different server than last time:
+                auto *bc = pickOtherServer(addressServers_[status.address]);
+                if (!bc)
+                    break;
 
-            if (bc->addressSubscribed(status.address))
-                fetchAddress(status.address, bc);
-            else
                 subscribeAddress(status.address, bc);
-        }
-        else if (status.needsCheck)
-        {
-            // Try to use a different server than last time:
-            auto *bc = pickOtherServer(addressServers_[status.address]);
-            if (!bc)
-                break;
-
-            subscribeAddress(status.address, bc);
+            }
         }
     }
 
     // Grab block headers that we don't have:
     while (true)
     {
-        size_t headerNeeded = cache_.blocks.headerNeeded();
+        size_t headerNeeded = blocks_.headerNeeded();
         if (!headerNeeded)
             break;
 
@@ -227,23 +268,34 @@ TxUpdater::wakeup()
 
         blockHeaderFetch(headerNeeded, bc);
     }
-    cache_.blocks.save();
-    cache_.blocks.onHeaderInvoke();
-    cache_.servers.save();
+    blocks_.save();
+    blocks_.onHeaderInvoke();
+    servers_.save();
 
-    // Save the cache if it is dirty and enough time has elapsed:
-    if (cacheDirty)
+    // Save the caches that are dirty and have waited long enough:
+    time_t now = time(nullptr);
+    for (auto &wallet: wallets_)
     {
-        time_t now = time(nullptr);
-
-        if (10 <= now - cacheLastSave)
+        auto &row = wallet.second;
+        if (row.cacheDirty && 10 <= now - row.cacheLastSave)
         {
-            cache_.save().log(); // Failure is fine
-            cacheLastSave = now;
-            cacheDirty = false;
+            row.cache->save().log(); // Failure is fine
+            row.cacheLastSave = now;
+            row.cacheDirty = false;
         }
     }
 
+    // Give slow fetches a second chance:
+    hedgeFetches();
+
+    // Send everything we just scheduled, one write per server:
+    for (auto *bc: connections_)
+    {
+        auto *sc = dynamic_cast<StratumConnection *>(bc);
+        if (sc && !sc->flush().log())
+            failedServers_.insert(bc->uri());
+    }
+
     // Prune failed servers:
     for (const auto &uri: failedServers_)
     {
@@ -254,9 +306,18 @@ TxUpdater::wakeup()
             if (uri == bc->uri())
             {
                 ABC_DebugLog("Disconnecting from %s", bc->uri().c_str());
-                cache_.servers.serverScoreDown(bc->uri());
+                servers_.serverScoreDown(bc->uri());
                 delete bc;
                 i = connections_.erase(i);
+
+                // Forget any subscriptions that never got a reply:
+                for (auto wip = wipSubscribes_.begin(); wip != wipSubscribes_.end(); )
+                {
+                    if (uri == wip->second)
+                        wip = wipSubscribes_.erase(wip);
+                    else
+                        ++wip;
+                }
             }
             else
             {
@@ -281,13 +342,7 @@ TxUpdater::pollitems()
     {
         auto *sc = dynamic_cast<StratumConnection *>(bc);
         if (sc)
-        {
-            zmq_pollitem_t pollitem =
-            {
-                nullptr, sc->pollfd(), ZMQ_POLLIN, ZMQ_POLLOUT
-            };
-            out.push_back(pollitem);
-        }
+            out.splice(out.end(), sc->pollitems());
 
         auto *lc = dynamic_cast<LibbitcoinConnection *>(bc);
         if (lc)
@@ -303,7 +358,7 @@ TxUpdater::sendTx(StatusCallback status, DataSlice tx)
     {
         // Pick one (and only one) stratum server for the broadcast:
         auto *sc = dynamic_cast<StratumConnection *>(bc);
-        if (sc)
+        if (sc && sc->connected())
         {
             sc->sendTx(status, tx);
             return;
@@ -339,7 +394,8 @@ TxUpdater::connectTo(std::string server, ServerType serverType)
     else if (ServerTypeStratum == serverType)
     {
         // Stratum server:
-        std::unique_ptr<StratumConnection> sc(new StratumConnection());
+        std::unique_ptr<StratumConnection> sc(
+            new StratumConnection(STRATUM_WINDOW));
         ABC_CHECK(sc->connect(server));
         bc.reset(sc.release());
     }
@@ -385,20 +441,133 @@ TxUpdater::pickServer(const std::string &name)
 IBitcoinConnection *
 TxUpdater::pickOtherServer(const std::string &name)
 {
+    IBitcoinConnection *best = nullptr;
     IBitcoinConnection *fallback = nullptr;
+    double bestTime = 0;
 
     for (auto *bc: connections_)
     {
         if (!bc->queueFull() && !failedServers_.count(bc->uri()))
         {
-            if (name != bc->uri())
-                return bc; // Just what we want!
-            else
+            if (name == bc->uri())
+            {
                 fallback = bc; // Not our first choice, but tolerable.
+                continue;
+            }
+
+            // Just what we want, if it is the fastest:
+            const auto time = expectedTime(bc);
+            if (!best || time < bestTime)
+            {
+                best = bc;
+                bestTime = time;
+            }
         }
     }
 
-    return fallback;
+    return best ? best : fallback;
+}
+
+void
+TxUpdater::latencyRecord(const std::string &uri, unsigned long long ms)
+{
+    servers_.setResponseTime(uri, ms);
+
+    auto &latency = latencies_[uri];
+    if (latency.samples.empty())
+        latency.average = ms;
+    else
+        latency.average += LATENCY_WEIGHT * (ms - latency.average);
+
+    latency.samples.push_back(ms);
+    if (LATENCY_SAMPLES < latency.samples.size())
+        latency.samples.pop_front();
+}
+
+double
+TxUpdater::expectedTime(IBitcoinConnection *bc)
+{
+    auto i = latencies_.find(bc->uri());
+    const double latency = latencies_.end() == i || i->second.samples.empty() ?
+                           DEFAULT_LATENCY_MS : i->second.average;
+
+    // Requests ahead of us are answered in order:
+    return latency * (bc->queueSize() + 1);
+}
+
+unsigned long long
+TxUpdater::hedgeDelay(const std::string &uri)
+{
+    auto i = latencies_.find(uri);
+    if (latencies_.end() == i || i->second.samples.size() < 4)
+        return DEFAULT_HEDGE_MS;
+
+    std::vector<unsigned long long> samples(i->second.samples.begin(),
+                                            i->second.samples.end());
+    auto p95 = samples.begin() + (samples.size() * 95) / 100;
+    if (samples.end() == p95)
+        --p95;
+    std::nth_element(samples.begin(), p95, samples.end());
+    return std::max(*p95, MINIMUM_HEDGE_MS);
+}
+
+void
+TxUpdater::hedgeFetches()
+{
+    const auto now = ServerCache::getCurrentTimeMilliSeconds();
+
+    // Find the slow fetches first, since hedging changes the lists:
+    auto slow = [this, now](const std::map<std::string, WipFetch> &wip)
+    {
+        std::list<std::pair<std::string, std::string> > out;
+        for (const auto &i: wip)
+        {
+            const auto &fetch = i.second;
+            if (fetch.hedged || 1 != fetch.servers.size())
+                continue;
+
+            const auto &uri = *fetch.servers.begin();
+            if (fetch.start + hedgeDelay(uri) <= now)
+                out.push_back(std::make_pair(i.first, uri));
+        }
+        return out;
+    };
+
+    for (const auto &i: slow(wipAddresses_))
+    {
+        auto *bc = pickOtherServer(i.second);
+        if (!bc)
+            break;
+        if (i.second == bc->uri())
+            continue;
+
+        ABC_DebugLog("%s: %s slow, also asking %s", i.second.c_str(),
+                     i.first.c_str(), bc->uri().c_str());
+        fetchAddress(i.first, bc, true);
+    }
+
+    for (const auto &i: slow(wipTxFetches_))
+    {
+        auto *bc = pickOtherServer(i.second);
+        if (!bc)
+            break;
+        if (i.second == bc->uri())
+            continue;
+
+        ABC_DebugLog("%s: tx %s slow, also asking %s", i.second.c_str(),
+                     i.first.c_str(), bc->uri().c_str());
+        fetchTx(i.first, "", bc, true);
+    }
+}
+
+std::list<TxUpdater::WalletRow *>
+TxUpdater::owners(const std::string &address)
+{
+    std::list<WalletRow *> out;
+    for (auto &wallet: wallets_)
+        if (wallet.second.cache->addresses.contains(address))
+            out.push_back(&wallet.second);
+    return out;
 }
 
 void
@@ -418,36 +587,40 @@ TxUpdater::subscribeHeight(IBitcoinConnection *bc)
     {
         // Set the response time in the cache
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        latencyRecord(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: height %d returned %d ms", uri.c_str(), height,
                      responseTime - queryTime);
-        size_t oldHeight = cache_.blocks.heightSet(height);
+        size_t oldHeight = blocks_.heightSet(height);
 
         if (oldHeight > height + 2)
         {
             // This server is behind in block height. Disconnect then penalize it a lot
-            cache_.servers.serverScoreDown(uri, 20);
+            servers_.serverScoreDown(uri, 20);
         }
         else if (oldHeight <= height)
         {
-            cache_.servers.serverScoreUp(uri); // Point for returning a valid height
+            servers_.serverScoreUp(uri); // Point for returning a valid height
             if (oldHeight < height)
             {
-                cache_.servers.serverScoreUp(uri); // Point for returning a newer height
+                servers_.serverScoreUp(uri); // Point for returning a newer height
 
 
                 // Update addresses with unconfirmed txs:
-                const auto statuses = cache_.txs.statuses(cache_.addresses.txids());
-                for (const auto status: statuses)
+                for (auto &wallet: wallets_)
                 {
-                    if (!status.second.height)
+                    auto &cache = *wallet.second.cache;
+                    const auto statuses = cache.txs.statuses(cache.addresses.txids());
+                    for (const auto status: statuses)
                     {
-                        for (const auto &io: status.first.ios)
+                        if (!status.second.height)
                         {
-                            ABC_DebugLog("Marking %s dirty (tx height check)",
-                                         io.address.c_str());
-                            cache_.addresses.updateStratumHash(io.address);
+                            for (const auto &io: status.first.ios)
+                            {
+                                ABC_DebugLog("Marking %s dirty (tx height check)",
+                                             io.address.c_str());
+                                cache.addresses.updateStratumHash(io.address);
+                            }
                         }
                     }
                 }
@@ -464,7 +637,8 @@ TxUpdater::subscribeAddress(const std::string &address, IBitcoinConnection *bc)
     // If we are already subscribed, mark the address as up-to-date:
     if (bc->addressSubscribed(address))
     {
-        cache_.addresses.updateSubscribe(address);
+        for (auto *wallet: owners(address))
+            wallet->cache->addresses.updateSubscribe(address);
         return;
     }
 
@@ -474,13 +648,26 @@ TxUpdater::subscribeAddress(const std::string &address, IBitcoinConnection *bc)
         ABC_DebugLog("%s: %s subscribe failed (%s)",
                      uri.c_str(), address.c_str(), s.message().c_str());
         failedServers_.insert(uri);
+        wipSubscribes_.erase(address);
     };
 
     auto onReply = [this, address, uri](const std::string &stateHash)
     {
-        if (cache_.addresses.updateStratumHash(address, stateHash))
+        wipSubscribes_.erase(address);
+
+        // A matching hash counts as a check, so nobody asks again soon:
+        bool dirty = false;
+        for (auto *wallet: owners(address))
+        {
+            if (wallet->cache->addresses.updateStratumHash(address, stateHash))
+                dirty = true;
+            else
+                wallet->cache->addresses.updateSubscribe(address);
+        }
+
+        if (dirty)
         {
-            cache_.servers.serverScoreUp(uri); // Point for returning a new hash
+            servers_.serverScoreUp(uri); // Point for returning a new hash
             addressServers_[address] = uri;
             ABC_DebugLog("%s: %s subscribe reply (dirty) %s",
                          uri.c_str(), address.c_str(), stateHash.c_str());
@@ -492,67 +679,137 @@ TxUpdater::subscribeAddress(const std::string &address, IBitcoinConnection *bc)
         }
     };
 
+    wipSubscribes_[address] = uri;
     bc->addressSubscribe(onError, onReply, address);
 }
 
 void
-TxUpdater::fetchAddress(const std::string &address, IBitcoinConnection *bc)
+TxUpdater::subscribeWallet(WalletRow &row)
 {
-    if (wipAddresses_.count(address))
+    // Find the server holding the subscription, or pick a new one:
+    StratumConnection *server = nullptr;
+    for (auto *bc: connections_)
+    {
+        auto *sc = dynamic_cast<StratumConnection *>(bc);
+        if (sc && row.subscribeServer == sc->uri() &&
+                !failedServers_.count(sc->uri()))
+            server = sc;
+    }
+    if (!server)
+    {
+        for (auto *bc: connections_)
+        {
+            auto *sc = dynamic_cast<StratumConnection *>(bc);
+            if (!sc || !sc->connected() || failedServers_.count(sc->uri()))
+                continue;
+
+            const auto addresses = row.cache->addresses.list();
+            row.subscribeServer = sc->uri();
+            row.subscribeQueue.assign(addresses.begin(), addresses.end());
+            server = sc;
+
+            ABC_DebugLog("%s: subscribing to %zu addresses",
+                         sc->uri().c_str(), addresses.size());
+            break;
+        }
+    }
+    if (!server)
         return;
-    wipAddresses_.insert(address);
 
+    // Only fill the server's window, leaving the rest for later wakeups:
+    while (!row.subscribeQueue.empty() && !server->queueFull())
+    {
+        const auto address = row.subscribeQueue.front();
+        row.subscribeQueue.pop_front();
+        if (!wipSubscribes_.count(address))
+            subscribeAddress(address, server);
+    }
+}
+
+void
+TxUpdater::fetchAddress(const std::string &address, IBitcoinConnection *bc,
+                        bool hedge)
+{
+    unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
     const auto uri = bc->uri();
+
+    auto wip = wipAddresses_.find(address);
+    if (hedge)
+    {
+        if (wipAddresses_.end() == wip)
+            return;
+        wip->second.hedged = true;
+        wip->second.servers.insert(uri);
+    }
+    else
+    {
+        if (wipAddresses_.end() != wip)
+            return;
+        auto &fetch = wipAddresses_[address];
+        fetch.start = queryTime;
+        fetch.servers.insert(uri);
+    }
+
     auto onError = [this, address, uri](Status s)
     {
         ABC_DebugLog("%s: %s fetch failed (%s)",
                      uri.c_str(), address.c_str(), s.message().c_str());
         failedServers_.insert(uri);
-        wipAddresses_.erase(address);
-    };
 
-    unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
+        // The fetch is only over once every server has given up:
+        auto wip = wipAddresses_.find(address);
+        if (wipAddresses_.end() != wip)
+        {
+            wip->second.servers.erase(uri);
+            if (wip->second.servers.empty())
+                wipAddresses_.erase(wip);
+        }
+    };
 
     auto onReply = [this, address, uri, queryTime](const AddressHistory &history)
     {
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        latencyRecord(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: %s fetched %d TXIDs %d ms", uri.c_str(), address.c_str(),
                      history.size(), responseTime - queryTime);
-        wipAddresses_.erase(address);
+
+        // If another server beat us to it, we are done:
+        auto wip = wipAddresses_.find(address);
+        if (wipAddresses_.end() == wip || !wip->second.servers.count(uri))
+            return;
+        wipAddresses_.erase(wip);
         addressServers_[address] = uri;
 
+        const auto wallets = owners(address);
         TxidSet txids;
         for (auto &row: history)
         {
-            cache_.txs.confirmed(row.first, row.second);
+            for (auto *wallet: wallets)
+                wallet->cache->txs.confirmed(row.first, row.second);
             txids.insert(row.first);
         }
 
-        if (!history.empty())
-        {
-            cache_.addresses.update(address, txids);
-            cache_.servers.serverScoreUp(uri);
+        // An empty history only makes sense for addresses without a hash:
+        std::string hash;
+        if (history.empty())
+            for (auto *wallet: wallets)
+                if (hash.empty())
+                    hash = wallet->cache->addresses.getStratumHash(address);
 
+        if (hash.empty())
+        {
+            for (auto *wallet: wallets)
+                wallet->cache->addresses.update(address, txids);
+            servers_.serverScoreUp(uri);
         }
         else
         {
-            std::string hash = cache_.addresses.getStratumHash(address);
-            if (hash.empty())
-            {
-
-                cache_.addresses.update(address, txids);
-                cache_.servers.serverScoreUp(uri);
-            }
-            else
-            {
-                ABC_DebugLog("%s: %s SERVER ERROR EMPTY TXIDs with hash %s", uri.c_str(),
-                             address.c_str(), hash.c_str());
-                // Do not trust current server. Force a new server.
-                failedServers_.insert(uri);
-                cache_.servers.serverScoreDown(uri, 20);
-            }
+            ABC_DebugLog("%s: %s SERVER ERROR EMPTY TXIDs with hash %s", uri.c_str(),
+                         address.c_str(), hash.c_str());
+            // Do not trust current server. Force a new server.
+            failedServers_.insert(uri);
+            servers_.serverScoreDown(uri, 20);
         }
     };
 
@@ -560,35 +817,82 @@ TxUpdater::fetchAddress(const std::string &address, IBitcoinConnection *bc)
 }
 
 void
-TxUpdater::fetchTx(const std::string &txid, IBitcoinConnection *bc)
+TxUpdater::fetchTx(const std::string &txid, const std::string &walletId,
+                   IBitcoinConnection *bc, bool hedge)
 {
-    if (wipTxids_.count(txid))
-        return;
-    wipTxids_.insert(txid);
-
+    unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
     const auto uri = bc->uri();
+
+    if (hedge)
+    {
+        // The wallets are already listed, so just add the server:
+        auto fetch = wipTxFetches_.find(txid);
+        if (wipTxFetches_.end() == fetch)
+            return;
+        fetch->second.hedged = true;
+        fetch->second.servers.insert(uri);
+    }
+    else
+    {
+        // If another wallet is already fetching this, just tag along:
+        auto wip = wipTxids_.find(txid);
+        if (wipTxids_.end() != wip)
+        {
+            wip->second.insert(walletId);
+            return;
+        }
+        wipTxids_[txid].insert(walletId);
+
+        auto &fetch = wipTxFetches_[txid];
+        fetch.start = queryTime;
+        fetch.servers.insert(uri);
+    }
+
     auto onError = [this, txid, uri](Status s)
     {
         ABC_DebugLog("%s: tx %s fetch failed (%s)",
                      uri.c_str(), txid.c_str(), s.message().c_str());
         failedServers_.insert(uri);
+
+        // The fetch is only over once every server has given up:
+        auto fetch = wipTxFetches_.find(txid);
+        if (wipTxFetches_.end() != fetch)
+        {
+            fetch->second.servers.erase(uri);
+            if (!fetch->second.servers.empty())
+                return;
+            wipTxFetches_.erase(fetch);
+        }
         wipTxids_.erase(txid);
     };
 
-    unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
-
     auto onReply = [this, txid, uri, queryTime](const bc::transaction_type &tx)
     {
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        latencyRecord(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: tx %s fetched", uri.c_str(), txid.c_str());
-        wipTxids_.erase(txid);
 
-        cache_.txs.insert(tx);
-        cache_.addresses.update();
-        cacheDirty = true;
-        cache_.servers.serverScoreUp(uri);
+        // If another server beat us to it, we are done:
+        auto wip = wipTxids_.find(txid);
+        if (wipTxids_.end() == wip)
+            return;
+        const auto walletIds = wip->second;
+        wipTxids_.erase(wip);
+        wipTxFetches_.erase(txid);
+
+        // Wallets that have gone away are no longer in the list:
+        for (const auto &id: walletIds)
+        {
+            auto wallet = wallets_.find(id);
+            if (wallets_.end() == wallet)
+                continue;
+
+            wallet->second.cache->txs.insert(tx);
+            wallet->second.cache->addresses.update();
+            wallet->second.cacheDirty = true;
+        }
+        servers_.serverScoreUp(uri);
     };
 
     ABC_DebugLog("%s: tx %s requested", uri.c_str(), txid.c_str());
@@ -609,7 +913,7 @@ TxUpdater::fetchFeeEstimate(size_t blocks, StratumConnection *sc)
     auto onReply = [this, blocks, uri, queryTime](double fee)
     {
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        latencyRecord(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: returned fee %lf for %d blocks %d ms",
                      uri.c_str(), fee, blocks, responseTime - queryTime);
@@ -635,14 +939,14 @@ TxUpdater::blockHeaderFetch(size_t height, IBitcoinConnection *bc)
                           queryTime](const bc::block_header_type &header)
     {
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        latencyRecord(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: header %d fetched %d ms",
                      uri.c_str(), height, responseTime - queryTime);
 
-        bool didInsert = cache_.blocks.headerInsert(height, header);
+        bool didInsert = blocks_.headerInsert(height, header);
         if (didInsert)
-            cache_.servers.serverScoreUp(uri);
+            servers_.serverScoreUp(uri);
     };
 
     bc->blockHeaderFetch(onError, onReply, height);
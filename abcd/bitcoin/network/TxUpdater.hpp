@@ -13,26 +13,45 @@
 #include "../cache/ServerCache.hpp"
 #include <zmq.h>
 #include <chrono>
+#include <deque>
 #include <map>
+#include <memory>
 
 namespace abcd {
 
+class BlockCache;
 class Cache;
 class IBitcoinConnection;
 class StratumConnection;
 
 /**
  * Syncs a set of transactions with the bitcoin server.
+ * A single updater serves every wallet in the process,
+ * so the wallets share one pool of server connections.
  */
 class TxUpdater
 {
 public:
     ~TxUpdater();
-    TxUpdater(Cache &cache, void *ctx);
+    TxUpdater(BlockCache &blocks, ServerCache &servers, void *ctx);
 
     void disconnect();
     Status connect();
 
+    /**
+     * Begins syncing a wallet's caches.
+     * The updater holds the pointer until the wallet is removed,
+     * so the caller can use it to keep the wallet alive.
+     */
+    void
+    walletAdd(const std::string &id, std::shared_ptr<Cache> cache);
+
+    /**
+     * Stops syncing a wallet's caches.
+     */
+    void
+    walletRemove(const std::string &id);
+
     /**
      * Performs any pending work.
      * Returns the number of milliseconds until the next work will be ready.
@@ -56,12 +75,24 @@ public:
 private:
     Status connectTo(std::string server, ServerType serverType);
 
-    Cache &cache_;
+    BlockCache &blocks_;
+    ServerCache &servers_;
     void *ctx_;
 
     bool wantConnection = false;
-    bool cacheDirty = false;
-    time_t cacheLastSave = 0;
+
+    struct WalletRow
+    {
+        std::shared_ptr<Cache> cache;
+        bool cacheDirty = false;
+        time_t cacheLastSave = 0;
+
+        // The stratum server holding the whole-wallet subscription,
+        // and the addresses still waiting for room in its window:
+        std::string subscribeServer;
+        std::deque<std::string> subscribeQueue;
+    };
+    std::map<std::string, WalletRow> wallets_;
 
     std::vector<IBitcoinConnection *> connections_;
 //    std::vector<std::string> serverList_;
@@ -70,9 +101,31 @@ private:
     std::vector<std::string> stratumServers_;
     std::vector<std::string> libbitcoinServers_;
 
-    // Fetches currently in progress:
-    AddressSet wipAddresses_;
-    TxidSet wipTxids_;
+    /**
+     * A fetch in progress, which may be running on more than one server.
+     */
+    struct WipFetch
+    {
+        unsigned long long start = 0; // Milliseconds, as in `ServerCache`
+        std::set<std::string> servers;
+        bool hedged = false;
+    };
+
+    // Fetches currently in progress, along with the wallets that need them:
+    std::map<std::string, WipFetch> wipAddresses_;
+    std::map<std::string, std::string> wipSubscribes_; // address -> server
+    std::map<std::string, std::set<std::string> > wipTxids_;
+    std::map<std::string, WipFetch> wipTxFetches_;
+
+    /**
+     * Recent reply times for each server.
+     */
+    struct ServerLatency
+    {
+        double average = 0; // Moving average, in milliseconds
+        std::deque<unsigned long long> samples; // Newest last
+    };
+    std::map<std::string, ServerLatency> latencies_;
 
     /**
      * The last server used to query the address.
@@ -86,6 +139,33 @@ private:
      */
     std::set<std::string> failedServers_;
 
+    /**
+     * Records a reply time, both here and in the server cache.
+     */
+    void
+    latencyRecord(const std::string &uri, unsigned long long ms);
+
+    /**
+     * Estimates how long a new request to this server would take,
+     * based on its recent reply times and how many requests are ahead.
+     */
+    double
+    expectedTime(IBitcoinConnection *bc);
+
+    /**
+     * How long to wait on a server before asking a second one.
+     * This is the server's 95th-percentile reply time.
+     */
+    unsigned long long
+    hedgeDelay(const std::string &uri);
+
+    /**
+     * Sends fetches that have outlived their hedge delay
+     * to a second server. Whichever answers first wins.
+     */
+    void
+    hedgeFetches();
+
     /**
      * Finds the requested server, assuming it is even connected and ready.
      * @return The best available server,
@@ -95,24 +175,45 @@ private:
     pickServer(const std::string &name);
 
     /**
-     * Tries to pick a different server than the one provided.
+     * Tries to pick a different server than the one provided,
+     * preferring the one with the lowest expected reply time.
      * @return The best available server,
      * or a null pointer if there are no free servers.
      */
     IBitcoinConnection *
     pickOtherServer(const std::string &name="");
 
+    /**
+     * Lists the wallets that are watching an address,
+     * since server replies need to reach all of them.
+     */
+    std::list<WalletRow *>
+    owners(const std::string &address);
+
     void
     subscribeHeight(IBitcoinConnection *bc);
 
     void
     subscribeAddress(const std::string &address, IBitcoinConnection *bc);
 
+    /**
+     * Subscribes to all of a wallet's addresses on one stratum server,
+     * unless a live server already has them.
+     * The subscriptions go out as the server's window allows,
+     * so each wakeup sends another batch as the replies come back.
+     * The replies carry status hashes, so only the addresses
+     * whose hashes changed go on to fetch their full history.
+     */
+    void
+    subscribeWallet(WalletRow &row);
+
     void
-    fetchAddress(const std::string &address, IBitcoinConnection *bc);
+    fetchAddress(const std::string &address, IBitcoinConnection *bc,
+                 bool hedge=false);
 
     void
-    fetchTx(const std::string &txid, IBitcoinConnection *bc);
+    fetchTx(const std::string &txid, const std::string &walletId,
+            IBitcoinConnection *bc, bool hedge=false);
 
     void
     fetchFeeEstimate(size_t blocks, StratumConnection *sc);
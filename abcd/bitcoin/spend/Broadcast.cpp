@@ -14,6 +14,7 @@
 #include "../../json/JsonObject.hpp"
 #include "../../util/Debug.hpp"
 #include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -54,97 +55,184 @@ blockchainPostTx(DataSlice tx)
 }
 
 /**
- * Contains a condition variable and its associated mutex.
- * The mutex protects access to some piece of shared data,
- * and the condition variable triggers a wakeup when the data is modified.
+ * The most requests we will have in flight to any one HTTP endpoint.
  */
-struct Syncer
-{
-    std::condition_variable cv;
-    std::mutex mutex;
-};
+constexpr size_t endpointWorkers = 2;
 
 /**
- * Holds the return value from a long-running background task,
- * and a flag indicating if the task is done yet.
+ * A bounded set of worker threads for one HTTP endpoint.
+ * Broadcasts queue up here, so a burst of payouts
+ * never opens more than a few connections at once.
+ * Idle workers exit, so nothing lingers between bursts.
  */
-struct DelayedStatus
+class BroadcastQueue
 {
-    bool done = false;
-    Status status;
+public:
+    typedef std::function<void ()> Task;
+
+    void
+    push(const Task &task)
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->tasks.push_back(task);
+        if (state_->workers < endpointWorkers)
+        {
+            ++state_->workers;
+            std::thread(loop, state_).detach();
+        }
+    }
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        size_t workers = 0;
+    };
+    // Shared with the workers, which can outlive the queue at shutdown:
+    std::shared_ptr<State> state_ = std::make_shared<State>();
+
+    static void
+    loop(std::shared_ptr<State> state)
+    {
+        while (true)
+        {
+            Task task;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->tasks.empty())
+                {
+                    --state->workers;
+                    return;
+                }
+                task = std::move(state->tasks.front());
+                state->tasks.pop_front();
+            }
+            task();
+        }
+    }
 };
 
+static BroadcastQueue gBlockchainQueue;
+static BroadcastQueue gInsightQueue;
+
 /**
- * A long-running broadcast task.
- * @param condition Guards access to the status,
- * and signals when the task is done.
- * @param status Holds the status of the task.
+ * Tracks one transaction as it goes out over the different routes.
  */
-template<Status (*f)(DataSlice tx)> static void
-broadcastTask(std::shared_ptr<Syncer> syncer,
-              std::shared_ptr<DelayedStatus> status, DataChunk tx)
+class BroadcastJob
 {
-    auto result = f(tx);
-
+public:
+    BroadcastJob(size_t routes, const BroadcastCallback &onDone):
+        errors_(routes),
+        pending_(routes),
+        onDone_(onDone)
+    {}
+
+    /**
+     * Records the outcome of one route,
+     * and fires the callback once the overall outcome is known.
+     */
+    void
+    finish(size_t route, Status status)
     {
-        std::lock_guard<std::mutex> lock(syncer->mutex);
-        status->status = result;
-        status->done = true;
+        Status out;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (done_)
+                return;
+
+            errors_[route] = status;
+            --pending_;
+            if (!status && pending_)
+                return;
+
+            done_ = true;
+            if (!status)
+                out = errors_[0];
+        }
+        onDone_(out);
     }
-    syncer->cv.notify_all();
-}
 
-Status
-broadcastTx(Wallet &self, DataSlice rawTx)
+private:
+    std::mutex mutex_;
+    std::vector<Status> errors_;
+    size_t pending_;
+    bool done_ = false;
+    BroadcastCallback onDone_;
+};
+
+void
+broadcastTxAsync(Wallet &self, DataSlice rawTx,
+                 const BroadcastCallback &onDone)
 {
-    // Create communication resources:
-    auto syncer = std::make_shared<Syncer>();
-    auto s1 = std::make_shared<DelayedStatus>();
-    auto s2 = std::make_shared<DelayedStatus>();
-    auto s3 = std::make_shared<DelayedStatus>();
+    auto job = std::make_shared<BroadcastJob>(3, onDone);
+    auto tx = std::make_shared<DataChunk>(rawTx.begin(), rawTx.end());
 
     // Launch the broadcasts:
-    DataChunk tx(rawTx.begin(), rawTx.end());
-    std::thread(broadcastTask<blockchainPostTx>, syncer, s1, tx).detach();
-    std::thread(broadcastTask<insightPostTx>, syncer, s2, tx).detach();
+    gBlockchainQueue.push([job, tx]()
+    {
+        job->finish(0, blockchainPostTx(*tx));
+    });
+    gInsightQueue.push([job, tx]()
+    {
+        job->finish(1, insightPostTx(*tx));
+    });
 
     // Queue up an async broadcast over the TxUpdater:
-    auto updaterDone = [syncer, s3](Status s)
+    auto updaterDone = [job](Status s)
     {
-        {
-            std::lock_guard<std::mutex> lock(syncer->mutex);
-            s3->status = s;
-            s3->done = true;
-            if (s)
-                ABC_DebugLog("Stratum broadcast OK");
-            else
-                s.log();
-        }
-        syncer->cv.notify_all();
+        if (s)
+            ABC_DebugLog("Stratum broadcast OK");
+        else
+            s.log();
+        job->finish(2, s);
     };
-    watcherSend(self, updaterDone, rawTx).log();
+    Status s = watcherSend(self, updaterDone, rawTx);
+    if (!s)
+        updaterDone(s);
+}
 
-    // Loop as long as any thread is still running:
-    while (true)
+void
+broadcastTxBatch(Wallet &self, const std::vector<DataChunk> &rawTxs,
+                 const BroadcastBatchCallback &onDone)
+{
+    for (size_t i = 0; i < rawTxs.size(); ++i)
     {
-        // Wait for the condition variable, which also acquires the lock:
-        std::unique_lock<std::mutex> lock(syncer->mutex);
-        syncer->cv.wait(lock);
-
-        // Stop waiting if any broadcast has succeeded:
-        if (s1->done && s1->status)
-            break;
-        if (s2->done && s2->status)
-            break;
-        if (s3->done && s3->status)
-            break;
-
-        // If they are all done, we have an error:
-        if (s1->done && s2->done && s3->done)
-            return s1->status;
+        broadcastTxAsync(self, rawTxs[i], [i, onDone](Status s)
+        {
+            onDone(i, s);
+        });
     }
+}
 
-    return Status();
+Status
+broadcastTx(Wallet &self, DataSlice rawTx)
+{
+    struct Result
+    {
+        std::condition_variable cv;
+        std::mutex mutex;
+        bool done = false;
+        Status status;
+    };
+    auto result = std::make_shared<Result>();
+
+    broadcastTxAsync(self, rawTx, [result](Status s)
+    {
+        {
+            std::lock_guard<std::mutex> lock(result->mutex);
+            result->status = s;
+            result->done = true;
+        }
+        result->cv.notify_all();
+    });
+
+    std::unique_lock<std::mutex> lock(result->mutex);
+    result->cv.wait(lock, [result]()
+    {
+        return result->done;
+    });
+    return result->status;
 }
 
 } // namespace abcd
@@ -10,17 +10,48 @@
 
 #include "../../util/Data.hpp"
 #include "../../util/Status.hpp"
+#include <functional>
+#include <vector>
 
 namespace abcd {
 
 class Wallet;
 
+/**
+ * Receives the outcome of a broadcast.
+ * The status is good if any of the broadcast routes accepted the
+ * transaction. Otherwise it holds the first route's error.
+ */
+typedef std::function<void (Status status)> BroadcastCallback;
+
+/**
+ * Receives the outcome of one transaction in a batch broadcast.
+ */
+typedef std::function<void (size_t index, Status status)>
+BroadcastBatchCallback;
+
 /**
  * Sends a transaction out to the Bitcoin network.
  */
 Status
 broadcastTx(Wallet &self, DataSlice rawTx);
 
+/**
+ * Sends a transaction out to the Bitcoin network in the background.
+ * The callback runs on a broadcast worker thread.
+ */
+void
+broadcastTxAsync(Wallet &self, DataSlice rawTx,
+                 const BroadcastCallback &onDone);
+
+/**
+ * Sends many transactions out to the Bitcoin network in the background.
+ * The callback fires once per transaction, with its index in the list.
+ */
+void
+broadcastTxBatch(Wallet &self, const std::vector<DataChunk> &rawTxs,
+                 const BroadcastBatchCallback &onDone);
+
 } // namespace abcd
 
 #endif
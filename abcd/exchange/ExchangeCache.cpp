@@ -10,11 +10,19 @@
 #include "../json/JsonArray.hpp"
 #include "../json/JsonObject.hpp"
 #include "../util/Debug.hpp"
+#include <chrono>
+#include <set>
 
 namespace abcd {
 
 #define SATOSHI_PER_BITCOIN 100000000
 
+/**
+ * How long to wait for a higher-priority source
+ * once some other source has answered.
+ */
+constexpr int preferredGraceMs = 2000;
+
 struct CacheJson:
     public JsonObject
 {
@@ -30,8 +38,14 @@ struct CacheJsonRow:
     ABC_JSON_INTEGER(timestamp, "timestamp", 0)
 };
 
+ExchangeCache::~ExchangeCache()
+{
+    stop();
+}
+
 ExchangeCache::ExchangeCache(const std::string &path):
-    path_(path)
+    path_(path),
+    stopping_(false)
 {
     load(); // Nothing bad happens if this fails
 }
@@ -46,50 +60,143 @@ ExchangeCache::update(Currencies currencies, const ExchangeSources &sources)
     if (fresh(currencies, now))
         return Status();
 
-    ExchangeRates allRates;
-    for (auto source: sources)
+    // Sources that have not answered yet, by priority:
+    std::map<std::string, size_t> ranks;
+    std::set<size_t> waiting;
+    for (const auto &source: sources)
     {
-        // Stop if the todo list is empty:
-        if (currencies.empty())
-            break;
+        if (!ranks.count(source))
+        {
+            const auto rank = ranks.size();
+            ranks[source] = rank;
+            waiting.insert(rank);
+        }
+    }
+
+    // The best answer so far for each currency:
+    struct Answer
+    {
+        size_t rank;
+        double rate;
+    };
+    std::map<Currency, Answer> answers;
+    bool answered = false;
+    auto graceEnd = std::chrono::steady_clock::now();
+
+    // We are done once every currency has an answer that a
+    // higher-priority source can no longer beat:
+    auto settled = [&]() -> bool
+    {
+        const bool grace = answered &&
+                           std::chrono::steady_clock::now() < graceEnd;
+        for (auto currency: currencies)
+        {
+            auto i = answers.find(currency);
+            if (answers.end() == i)
+                return false;
+            if (grace && !waiting.empty() && *waiting.begin() < i->second.rank)
+                return false;
+        }
+        return true;
+    };
 
-        ABC_DebugLevel(1, "ExchangeCache::update() %s", source.c_str());
+    auto onRates = [&](const std::string &source, Status s,
+                       const ExchangeRates &rates) -> bool
+    {
+        const auto rank = ranks[source];
+        waiting.erase(rank);
+        if (!s)
+        {
+            ABC_DebugLevel(1, "ExchangeCache::update() %s failed",
+                           source.c_str());
+            return !settled(); // Just skip the failed ones
+        }
 
-        // Grab the rates from the server:
-        ExchangeRates rates;
-        ExchangeRates ratesWanted;
-        if (!exchangeSourceFetch(rates, source))
-            continue; // Just skip the failed ones
+        if (!answered)
+        {
+            answered = true;
+            graceEnd = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(preferredGraceMs);
+        }
 
-        // Remove any new rates from the todo list:
         for (auto rate: rates)
         {
-            auto i = currencies.find(rate.first);
-            if (currencies.end() != i)
+            if (!currencies.count(rate.first))
+                continue;
+
+            auto i = answers.find(rate.first);
+            if (answers.end() == i || rank < i->second.rank)
             {
-                currencies.erase(i);
-                ratesWanted.insert(rate);
+                answers[rate.first] = Answer{rank, rate.second};
 
                 std::string code;
-                ABC_CHECK(currencyCode(code, rate.first));
-                ABC_DebugLevel(1, "ExchangeCache::update() %s %s %.2f", source.c_str(),
-                               code.c_str(), rate.second);
+                if (currencyCode(code, rate.first))
+                    ABC_DebugLevel(1, "ExchangeCache::update() %s %s %.2f",
+                                   source.c_str(), code.c_str(), rate.second);
             }
         }
+        return !settled();
+    };
 
-        // Add any new rates to the allRates list:
-        ratesWanted.insert(allRates.begin(), allRates.end());
-        allRates = std::move(ratesWanted);
-    }
+    auto keepGoing = [&]() -> bool
+    {
+        return !stopping_ && !settled();
+    };
+
+    ABC_CHECK(exchangeSourcesFetch(sources, onRates, keepGoing));
 
     // Add the rates to the cache:
-    for (auto rate: allRates)
-        ABC_CHECK(update(rate.first, rate.second, now));
+    for (auto answer: answers)
+        ABC_CHECK(update(answer.first, answer.second.rate, now));
     ABC_CHECK(save());
 
     return Status();
 }
 
+Status
+ExchangeCache::refresh(const Currencies &currencies,
+                       const ExchangeSources &sources)
+{
+    // Without a usable rate, the caller has to wait:
+    for (auto currency: currencies)
+    {
+        double r;
+        if (!rate(r, currency))
+            return update(currencies, sources);
+    }
+    if (fresh(currencies, time(nullptr)))
+        return Status();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pendingCurrencies_.insert(currencies.begin(), currencies.end());
+    pendingSources_ = sources;
+    if (refreshing_ || stopping_)
+        return Status();
+
+    // The previous thread has already run out of work:
+    if (refresher_.joinable())
+        refresher_.join();
+    refreshing_ = true;
+    refresher_ = std::thread(&ExchangeCache::refreshLoop, this);
+
+    return Status();
+}
+
+void
+ExchangeCache::stop()
+{
+    std::thread refresher;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        refresher = std::move(refresher_);
+    }
+
+    // The thread needs the mutex to finish, so join without it:
+    if (refresher.joinable())
+        refresher.join();
+}
+
 Status
 ExchangeCache::satoshiToCurrency(double &result, int64_t in, Currency currency)
 {
@@ -195,6 +302,28 @@ ExchangeCache::update(Currency currency, double rate, time_t now)
     return Status();
 }
 
+void
+ExchangeCache::refreshLoop()
+{
+    while (true)
+    {
+        Currencies currencies;
+        ExchangeSources sources;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pendingCurrencies_.empty() || stopping_)
+            {
+                refreshing_ = false;
+                return;
+            }
+            currencies.swap(pendingCurrencies_);
+            sources = pendingSources_;
+        }
+
+        update(currencies, sources).log();
+    }
+}
+
 bool
 ExchangeCache::fresh(const Currencies &currencies, time_t now)
 {
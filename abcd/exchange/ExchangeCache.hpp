@@ -11,8 +11,10 @@
 #include "Currency.hpp"
 #include "ExchangeSource.hpp"
 #include <time.h>
+#include <atomic>
 #include <map>
 #include <mutex>
+#include <thread>
 
 namespace abcd {
 
@@ -22,14 +24,33 @@ namespace abcd {
 class ExchangeCache
 {
 public:
+    ~ExchangeCache();
     ExchangeCache(const std::string &path);
 
     /**
-     * Updates the exchange rates, trying the sources in the given order.
+     * Updates the exchange rates, querying all the sources at once.
+     * Sources earlier in the list take priority,
+     * but only for a short while after the first answer arrives.
      */
     Status
     update(Currencies currencies, const ExchangeSources &sources);
 
+    /**
+     * Like `update`, but only waits for the network if there is no
+     * usable rate yet. Otherwise, the update happens in the background.
+     */
+    Status
+    refresh(const Currencies &currencies, const ExchangeSources &sources);
+
+    /**
+     * Waits for any background refresh to finish,
+     * and prevents new ones from starting.
+     * The refresh thread needs the global context,
+     * so this must happen before the context goes away.
+     */
+    void
+    stop();
+
     Status
     satoshiToCurrency(double &result, int64_t in, Currency currency);
 
@@ -47,6 +68,20 @@ private:
     };
     std::map<Currency, CacheRow> cache_;
 
+    // Background refresh state:
+    std::thread refresher_;
+    bool refreshing_ = false;
+    std::atomic<bool> stopping_;
+    Currencies pendingCurrencies_;
+    ExchangeSources pendingSources_;
+
+    /**
+     * The background thread body.
+     * Keeps updating until there is no more pending work.
+     */
+    void
+    refreshLoop();
+
     /**
      * Loads the cache from disk.
      */
@@ -6,11 +6,12 @@
  */
 
 #include "ExchangeSource.hpp"
-#include "../http/HttpRequest.hpp"
+#include "../http/HttpMulti.hpp"
 #include "../json/JsonArray.hpp"
 #include "../json/JsonObject.hpp"
 #include <string.h>
 #include <stdlib.h>
+#include <vector>
 
 namespace abcd {
 
@@ -59,17 +60,13 @@ doubleDecode(double &result, const char *in)
 }
 
 /**
- * Fetches exchange rates from the Bitstamp source.
+ * Decodes exchange rates from the Bitstamp source.
  */
 static Status
-fetchBitstamp(ExchangeRates &result)
+decodeBitstamp(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply, "https://www.bitstamp.net/api/ticker/"));
-    ABC_CHECK(reply.codeOk());
-
     BitstampJson json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
     ABC_CHECK(json.rateOk());
 
     double rate;
@@ -82,18 +79,13 @@ fetchBitstamp(ExchangeRates &result)
 }
 
 /**
- * Fetches exchange rates from the Bitfinex source.
+ * Decodes exchange rates from the Bitfinex source.
  */
 static Status
-fetchBitfinex(ExchangeRates &result)
+decodeBitfinex(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply,
-                                "https://api.bitfinex.com/v1/pubticker/btcusd"));
-    ABC_CHECK(reply.codeOk());
-
     BitfinexJson json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
     ABC_CHECK(json.rateOk());
 
     double rate;
@@ -106,17 +98,13 @@ fetchBitfinex(ExchangeRates &result)
 }
 
 /**
- * Fetches and decodes exchange rates from the BraveNewCoin source.
+ * Decodes exchange rates from the BraveNewCoin source.
  */
 static Status
-fetchBraveNewCoin(ExchangeRates &result)
+decodeBraveNewCoin(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply, "http://api.bravenewcoin.com/rates.json"));
-    ABC_CHECK(reply.codeOk());
-
     BraveNewCoinJson json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
     auto rates = json.rates();
 
     // Break apart the array:
@@ -157,18 +145,13 @@ fetchBraveNewCoin(ExchangeRates &result)
 }
 
 /**
- * Fetches and decodes exchange rates from the Coinbase source.
+ * Decodes exchange rates from the Coinbase source.
  */
 static Status
-fetchCoinbase(ExchangeRates &result)
+decodeCoinbase(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply,
-                                "https://coinbase.com/api/v1/currencies/exchange_rates"));
-    ABC_CHECK(reply.codeOk());
-
     JsonObject json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
 
     // Check for usable rates:
     ExchangeRates out;
@@ -204,18 +187,13 @@ fetchCoinbase(ExchangeRates &result)
 }
 
 /**
- * Fetches and decodes exchange rates from the BitcoinAverage source.
+ * Decodes exchange rates from the BitcoinAverage source.
  */
 static Status
-fetchBitcoinAverage(ExchangeRates &result)
+decodeBitcoinAverage(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply,
-                                "https://api.bitcoinaverage.com/ticker/global/all"));
-    ABC_CHECK(reply.codeOk());
-
     JsonObject json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
 
     // Check for usable rates:
     ExchangeRates out;
@@ -254,16 +232,87 @@ fetchBitcoinAverage(ExchangeRates &result)
     return Status();
 }
 
+/**
+ * Where to find a source, and how to read its reply.
+ */
+struct SourceInfo
+{
+    const char *url;
+    Status (*decode)(ExchangeRates &result, const std::string &body);
+};
+
+static Status
+sourceInfo(SourceInfo &result, const std::string &source)
+{
+    if (source == "Bitstamp")
+        result = SourceInfo{"https://www.bitstamp.net/api/ticker/",
+                            decodeBitstamp};
+    else if (source == "Bitfinex")
+        result = SourceInfo{"https://api.bitfinex.com/v1/pubticker/btcusd",
+                            decodeBitfinex};
+    else if (source == "BitcoinAverage")
+        result = SourceInfo{"https://api.bitcoinaverage.com/ticker/global/all",
+                            decodeBitcoinAverage};
+    else if (source == "BraveNewCoin")
+        result = SourceInfo{"http://api.bravenewcoin.com/rates.json",
+                            decodeBraveNewCoin};
+    else if (source == "Coinbase")
+        result = SourceInfo{"https://coinbase.com/api/v1/currencies/exchange_rates",
+                            decodeCoinbase};
+    else
+        return ABC_ERROR(ABC_CC_ParseError, "No exchange-rate source " + source);
+    return Status();
+}
 
 Status
 exchangeSourceFetch(ExchangeRates &result, const std::string &source)
 {
-    if (source == "Bitstamp")       return fetchBitstamp(result);
-    if (source == "Bitfinex")       return fetchBitfinex(result);
-    if (source == "BitcoinAverage") return fetchBitcoinAverage(result);
-    if (source == "BraveNewCoin")   return fetchBraveNewCoin(result);
-    if (source == "Coinbase")       return fetchCoinbase(result);
-    return ABC_ERROR(ABC_CC_ParseError, "No exchange-rate source " + source);
+    SourceInfo info;
+    ABC_CHECK(sourceInfo(info, source));
+
+    HttpReply reply;
+    ABC_CHECK(HttpRequest().get(reply, info.url));
+    ABC_CHECK(reply.codeOk());
+    ABC_CHECK(info.decode(result, reply.body));
+    return Status();
+}
+
+Status
+exchangeSourcesFetch(const ExchangeSources &sources,
+                     const ExchangeSourceCallback &onRates,
+                     const HttpMulti::ContinueCallback &keepGoing)
+{
+    const size_t size = sources.size();
+    std::vector<SourceInfo> infos(size);
+    std::vector<HttpRequest> requests(size);
+    std::vector<HttpReply> replies(size);
+
+    HttpMulti multi;
+    size_t i = 0;
+    for (const auto &source: sources)
+    {
+        auto &info = infos[i];
+        auto &reply = replies[i];
+        auto onDone = [&source, &info, &reply, onRates](Status s) -> bool
+        {
+            ExchangeRates rates;
+            if (s)
+                s = reply.codeOk();
+            if (s)
+                s = info.decode(rates, reply.body);
+            return onRates(source, s, rates);
+        };
+
+        Status s = sourceInfo(info, source);
+        if (s)
+            s = multi.get(requests[i], reply, info.url, onDone);
+        if (!s && !onRates(source, s, ExchangeRates()))
+            return Status();
+        ++i;
+    }
+
+    ABC_CHECK(multi.perform(keepGoing));
+    return Status();
 }
 
 } // namespace abcd
@@ -9,6 +9,8 @@
 #define ABCD_EXCHANGE_EXCHANGE_SOURCE_HPP
 
 #include "Currency.hpp"
+#include "../http/HttpMulti.hpp"
+#include <functional>
 #include <list>
 #include <map>
 
@@ -28,6 +30,22 @@ extern const ExchangeSources exchangeSources;
 Status
 exchangeSourceFetch(ExchangeRates &result, const std::string &source);
 
+/**
+ * Receives one source's answer, or the reason it failed.
+ * Return false to cancel the sources that have not answered yet.
+ */
+typedef std::function<bool (const std::string &source, Status status,
+                            const ExchangeRates &rates)> ExchangeSourceCallback;
+
+/**
+ * Queries several sources at once, reporting each answer as it arrives.
+ * Returns once every source has answered or the callbacks say to stop.
+ */
+Status
+exchangeSourcesFetch(const ExchangeSources &sources,
+                     const ExchangeSourceCallback &onRates,
+                     const HttpMulti::ContinueCallback &keepGoing=nullptr);
+
 } // namespace abcd
 
 #endif
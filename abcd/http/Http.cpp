@@ -14,6 +14,11 @@
 
 namespace abcd {
 
+/**
+ * The most idle handles a pool will hold on to.
+ */
+constexpr size_t maxIdle = 8;
+
 /**
  * Manages the cURL library global memory lifetime.
  */
@@ -28,6 +33,8 @@ struct HttpSingleton
 
 // Global variables:
 static HttpSingleton gSingleton;
+static HttpPool gPool;
+static HttpPool gPinnedPool;
 
 static void
 sslLockCallback(int mode, int n, const char *sourceFile, int sourceLine)
@@ -71,4 +78,85 @@ httpInit()
     return gSingleton.status;
 }
 
+HttpPool::~HttpPool()
+{
+    for (auto handle: idle_)
+        curl_easy_cleanup(handle);
+    if (share_) curl_share_cleanup(share_);
+}
+
+HttpPool::HttpPool():
+    share_(curl_share_init())
+{
+    if (share_)
+    {
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, shareLock);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, shareUnlock);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
+}
+
+CURL *
+HttpPool::acquire()
+{
+    CURL *out = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty())
+        {
+            out = idle_.back();
+            idle_.pop_back();
+        }
+    }
+
+    if (!out)
+        out = curl_easy_init();
+    if (out && share_)
+        curl_easy_setopt(out, CURLOPT_SHARE, share_);
+    return out;
+}
+
+void
+HttpPool::release(CURL *handle)
+{
+    // Resetting keeps the handle's connections and caches:
+    curl_easy_reset(handle);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < maxIdle)
+        idle_.push_back(handle);
+    else
+        curl_easy_cleanup(handle);
+}
+
+void
+HttpPool::shareLock(CURL *handle, curl_lock_data data,
+                    curl_lock_access access, void *userp)
+{
+    static_cast<HttpPool *>(userp)->shareMutexes_[data].lock();
+}
+
+void
+HttpPool::shareUnlock(CURL *handle, curl_lock_data data, void *userp)
+{
+    static_cast<HttpPool *>(userp)->shareMutexes_[data].unlock();
+}
+
+HttpPool &
+httpPool()
+{
+    return gPool;
+}
+
+HttpPool &
+httpPinnedPool()
+{
+    return gPinnedPool;
+}
+
 } // namespace abcd
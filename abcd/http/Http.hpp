@@ -9,6 +9,9 @@
 #define ABCD_HTTP_HTTP_HPP
 
 #include "../util/Status.hpp"
+#include <curl/curl.h>
+#include <mutex>
+#include <vector>
 
 namespace abcd {
 
@@ -18,6 +21,59 @@ namespace abcd {
 Status
 httpInit();
 
+/**
+ * Recycles cURL handles between requests.
+ * Handles from the same pool share a DNS cache, TLS sessions,
+ * and live connections, so back-to-back requests to the same server
+ * can skip the TCP and TLS handshakes.
+ */
+class HttpPool
+{
+public:
+    ~HttpPool();
+    HttpPool();
+
+    /**
+     * Takes an idle handle from the pool, or creates a new one.
+     * Returns nullptr if cURL cannot create a handle.
+     */
+    CURL *
+    acquire();
+
+    /**
+     * Clears a handle's options and puts it back in the pool.
+     */
+    void
+    release(CURL *handle);
+
+private:
+    std::mutex mutex_;
+    std::vector<CURL *> idle_;
+    CURLSH *share_;
+    std::mutex shareMutexes_[CURL_LOCK_DATA_LAST];
+
+    static void
+    shareLock(CURL *handle, curl_lock_data data, curl_lock_access access,
+              void *userp);
+
+    static void
+    shareUnlock(CURL *handle, curl_lock_data data, void *userp);
+};
+
+/**
+ * The pool for ordinary requests.
+ */
+HttpPool &
+httpPool();
+
+/**
+ * The pool for certificate-pinned requests.
+ * This is kept apart so a connection or TLS session set up without
+ * pinning can never be reused for a request that needs it.
+ */
+HttpPool &
+httpPinnedPool();
+
 } // namespace abcd
 
 #endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "HttpMulti.hpp"
+
+namespace abcd {
+
+/**
+ * How long to sleep between checks of the `keepGoing` callback.
+ */
+constexpr int pollMs = 100;
+
+static Status curlmOk(CURLMcode code)
+{
+    if (code)
+    {
+        std::string message("cURL multi error: ");
+        if (curl_multi_strerror(code))
+            message += curl_multi_strerror(code);
+        else
+            message += std::to_string(code);
+        return ABC_ERROR(ABC_CC_SysError, message);
+    }
+    return Status();
+}
+
+#define ABC_CHECK_CURLM(code) ABC_CHECK(curlmOk(code))
+
+HttpMulti::~HttpMulti()
+{
+    cancel();
+    if (handle_) curl_multi_cleanup(handle_);
+}
+
+HttpMulti::HttpMulti():
+    handle_(curl_multi_init())
+{
+}
+
+Status
+HttpMulti::get(HttpRequest &request, HttpReply &result,
+               const std::string &url, const DoneCallback &onDone)
+{
+    if (!handle_)
+        return ABC_ERROR(ABC_CC_Error, "cURL failed create multi handle");
+
+    ABC_CHECK(request.setup(result, url));
+    ABC_CHECK_CURLM(curl_multi_add_handle(handle_, request.handle_));
+    transfers_[request.handle_] = Transfer{&request, &result, url, onDone};
+    return Status();
+}
+
+Status
+HttpMulti::perform(const ContinueCallback &keepGoing)
+{
+    if (!handle_)
+        return ABC_ERROR(ABC_CC_Error, "cURL failed create multi handle");
+
+    while (!transfers_.empty())
+    {
+        int running;
+        ABC_CHECK_CURLM(curl_multi_perform(handle_, &running));
+
+        // Hand out the finished transfers:
+        CURLMsg *message;
+        int left;
+        while (nullptr != (message = curl_multi_info_read(handle_, &left)))
+        {
+            if (CURLMSG_DONE != message->msg)
+                continue;
+
+            auto i = transfers_.find(message->easy_handle);
+            if (transfers_.end() == i)
+                continue;
+            const auto transfer = i->second;
+            curl_multi_remove_handle(handle_, i->first);
+            transfers_.erase(i);
+
+            Status s = transfer.request->finish(*transfer.result, transfer.url,
+                                                message->data.result);
+            if (!transfer.onDone(s))
+            {
+                cancel();
+                return Status();
+            }
+        }
+
+        if (keepGoing && !keepGoing())
+        {
+            cancel();
+            return Status();
+        }
+
+        if (running)
+            ABC_CHECK_CURLM(curl_multi_wait(handle_, nullptr, 0, pollMs,
+                                            nullptr));
+    }
+
+    return Status();
+}
+
+void
+HttpMulti::cancel()
+{
+    for (const auto &i: transfers_)
+        curl_multi_remove_handle(handle_, i.first);
+    transfers_.clear();
+}
+
+} // namespace abcd
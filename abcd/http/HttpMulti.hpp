@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#ifndef ABCD_HTTP_HTTP_MULTI_HPP
+#define ABCD_HTTP_HTTP_MULTI_HPP
+
+#include "HttpRequest.hpp"
+#include <functional>
+#include <map>
+
+namespace abcd {
+
+/**
+ * Runs a batch of HTTP requests at the same time on the calling thread.
+ */
+class HttpMulti
+{
+public:
+    /**
+     * Receives the outcome of one transfer.
+     * Return false to abandon the rest of the batch.
+     */
+    typedef std::function<bool (Status status)> DoneCallback;
+
+    /**
+     * Polled while the batch runs. Return false to abandon the batch.
+     */
+    typedef std::function<bool ()> ContinueCallback;
+
+    ~HttpMulti();
+    HttpMulti();
+
+    /**
+     * Adds an HTTP GET operation to the batch.
+     * The request and reply must outlive the batch.
+     */
+    Status
+    get(HttpRequest &request, HttpReply &result, const std::string &url,
+        const DoneCallback &onDone);
+
+    /**
+     * Runs the batch until every transfer has finished,
+     * or until one of the callbacks says to stop.
+     * Transfers that are still running at that point are cancelled.
+     */
+    Status
+    perform(const ContinueCallback &keepGoing=nullptr);
+
+private:
+    CURLM *handle_;
+
+    struct Transfer
+    {
+        HttpRequest *request;
+        HttpReply *result;
+        std::string url;
+        DoneCallback onDone;
+    };
+    std::map<CURL *, Transfer> transfers_;
+
+    void
+    cancel();
+};
+
+} // namespace abcd
+
+#endif
@@ -6,6 +6,7 @@
  */
 
 #include "HttpRequest.hpp"
+#include "Http.hpp"
 #include "../Context.hpp"
 #include "../util/Debug.hpp"
 
@@ -76,12 +77,18 @@ HttpReply::codeOk() const
 
 HttpRequest::~HttpRequest()
 {
-    if (handle_) curl_easy_cleanup(handle_);
+    if (handle_) pool_.release(handle_);
     if (headers_) curl_slist_free_all(headers_);
 }
 
 HttpRequest::HttpRequest():
+    HttpRequest(httpPool())
+{
+}
+
+HttpRequest::HttpRequest(HttpPool &pool):
     handle_(nullptr),
+    pool_(pool),
     headers_(nullptr)
 {
     status_ = init();
@@ -117,28 +124,8 @@ HttpRequest::header(const std::string &key, const std::string &value)
 Status
 HttpRequest::get(HttpReply &result, const std::string &url)
 {
-    if (!status_)
-        return status_;
-
-    // Final options:
-    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_WRITEDATA, &result.body));
-    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION,
-                                    curlDataCallback));
-    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_URL, url.c_str()));
-    if (headers_)
-        ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_HTTPHEADER, headers_));
-
-    // Make the request:
-    ABC_CHECK_CURL(curl_easy_perform(handle_));
-    ABC_CHECK_CURL(curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE,
-                                     &result.code));
-    if (result.codeOk())
-        ABC_DebugLog("%s (%d)", url.c_str(), result.code);
-    else
-        ABC_DebugLog("%s (%d)\n%s", url.c_str(), result.code,
-                     result.body.c_str());
-
-    return Status();
+    ABC_CHECK(setup(result, url));
+    return finish(result, url, curl_easy_perform(handle_));
 }
 
 Status
@@ -164,15 +151,49 @@ HttpRequest::request(HttpReply &result, const std::string &url,
     return post(result, url, body);
 }
 
+Status
+HttpRequest::setup(HttpReply &result, const std::string &url)
+{
+    if (!status_)
+        return status_;
+
+    // Final options:
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_WRITEDATA, &result.body));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION,
+                                    curlDataCallback));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_URL, url.c_str()));
+    if (headers_)
+        ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_HTTPHEADER, headers_));
+
+    return Status();
+}
+
+Status
+HttpRequest::finish(HttpReply &result, const std::string &url,
+                    CURLcode code)
+{
+    ABC_CHECK_CURL(code);
+    ABC_CHECK_CURL(curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE,
+                                     &result.code));
+    if (result.codeOk())
+        ABC_DebugLog("%s (%d)", url.c_str(), result.code);
+    else
+        ABC_DebugLog("%s (%d)\n%s", url.c_str(), result.code,
+                     result.body.c_str());
+
+    return Status();
+}
+
 Status
 HttpRequest::init()
 {
-    handle_ = curl_easy_init();
+    handle_ = pool_.acquire();
     if (!handle_)
         return ABC_ERROR(ABC_CC_Error, "cURL failed create handle");
 
     // Basic options:
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_NOSIGNAL, 1));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_TCP_KEEPALIVE, 1L));
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_CONNECTTIMEOUT, TIMEOUT));
 
     const auto certPath = gContext->paths.certPath();
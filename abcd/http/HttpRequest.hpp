@@ -13,6 +13,8 @@
 
 namespace abcd {
 
+class HttpPool;
+
 struct HttpReply
 {
     /** The HTTP status code. */
@@ -35,6 +37,8 @@ class HttpRequest
 public:
     ~HttpRequest();
     HttpRequest();
+    HttpRequest(const HttpRequest &) = delete;
+    HttpRequest &operator=(const HttpRequest &) = delete;
 
     /**
      * Enables verbose debugging on the HTTP request.
@@ -72,10 +76,30 @@ protected:
     Status status_;
     CURL *handle_;
 
+    /**
+     * Takes the cURL handle from a specific pool.
+     */
+    explicit HttpRequest(HttpPool &pool);
+
 private:
+    HttpPool &pool_;
     struct curl_slist *headers_;
 
     Status init();
+
+    /**
+     * Sets up the handle to fetch a URL, without running it.
+     */
+    Status
+    setup(HttpReply &result, const std::string &url);
+
+    /**
+     * Collects the reply once the transfer is done.
+     */
+    Status
+    finish(HttpReply &result, const std::string &url, CURLcode code);
+
+    friend class HttpMulti;
 };
 
 } // namespace abcd
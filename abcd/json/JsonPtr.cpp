@@ -10,6 +10,7 @@
 #include "../crypto/Crypto.hpp"
 #include "../util/Debug.hpp"
 #include "../util/FileIO.hpp"
+#include "../util/Parallel.hpp"
 #include "../util/Util.hpp"
 #include <new>
 
@@ -144,6 +145,18 @@ JsonPtr::decode(const std::string &data)
     return Status();
 }
 
+Status
+JsonPtr::decode(DataSlice data)
+{
+    json_error_t error;
+    json_t *root = json_loadb(reinterpret_cast<const char *>(data.data()),
+                              data.size(), loadFlags, &error);
+    if (!root)
+        return ABC_ERROR(ABC_CC_JSONError, error.text);
+    reset(root);
+    return Status();
+}
+
 Status
 JsonPtr::save(const std::string &path) const
 {
@@ -189,4 +202,14 @@ JsonPtr::encode(bool compact) const
     return out;
 }
 
+void
+jsonLoadFiles(std::vector<JsonFile> &files, DataSlice dataKey)
+{
+    parallelFor(files.size(), [&](size_t i)
+    {
+        auto &file = files[i];
+        file.status = file.json.load(file.path, dataKey);
+    });
+}
+
 } // namespace abcd
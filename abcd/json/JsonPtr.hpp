@@ -11,6 +11,7 @@
 #include "../util/Status.hpp"
 #include "../util/Data.hpp"
 #include <jansson.h>
+#include <vector>
 
 namespace abcd {
 
@@ -69,6 +70,13 @@ public:
     Status
     decode(const std::string &data);
 
+    /**
+     * Loads the JSON object from an in-memory buffer,
+     * which does not need to be null-terminated.
+     */
+    Status
+    decode(DataSlice data);
+
     /**
      * Saves the JSON object to disk.
      */
@@ -91,6 +99,23 @@ protected:
     json_t *root_;
 };
 
+/**
+ * One file to load with `jsonLoadFiles`.
+ */
+struct JsonFile
+{
+    std::string path;
+    JsonPtr json;
+    Status status;
+};
+
+/**
+ * Loads and decrypts a batch of files at once, using several threads.
+ * Each file gets its own status, so one bad file does not spoil the rest.
+ */
+void
+jsonLoadFiles(std::vector<JsonFile> &files, DataSlice dataKey);
+
 /**
  * Adds the standard constructors to JsonPtr child classes.
  */
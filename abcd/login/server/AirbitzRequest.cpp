@@ -8,6 +8,7 @@
 #include "AirbitzRequest.hpp"
 #include "Pinning.hpp"
 #include "../../Context.hpp"
+#include "../../http/Http.hpp"
 #include <openssl/ssl.h>
 
 namespace abcd {
@@ -20,7 +21,8 @@ curlSslCallback(CURL *curl, void *ssl_ctx, void *userptr)
     return CURLE_OK;
 }
 
-AirbitzRequest::AirbitzRequest()
+AirbitzRequest::AirbitzRequest():
+    HttpRequest(httpPinnedPool())
 {
     if (!status_)
         return;
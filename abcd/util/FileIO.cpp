@@ -32,6 +32,24 @@ fileIsJson(const std::string &name)
     return 5 <= name.size() && std::equal(name.end() - 5, name.end(), ".json");
 }
 
+std::set<std::string>
+fileListJson(const std::string &dir)
+{
+    std::set<std::string> out;
+
+    DIR *handle = opendir(dir.c_str());
+    if (handle)
+    {
+        struct dirent *de;
+        while (nullptr != (de = readdir(handle)))
+            if (fileIsJson(de->d_name))
+                out.insert(de->d_name);
+        closedir(handle);
+    }
+
+    return out;
+}
+
 Status
 fileEnsureDir(const std::string &dir)
 {
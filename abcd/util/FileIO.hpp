@@ -15,6 +15,7 @@
 #include "Data.hpp"
 #include "Status.hpp"
 #include <time.h>
+#include <set>
 
 namespace abcd {
 
@@ -30,6 +31,13 @@ fileSlashify(const std::string &path);
 bool
 fileIsJson(const std::string &name);
 
+/**
+ * Lists the JSON files in a directory, sorted by name.
+ * A missing directory just gives an empty list.
+ */
+std::set<std::string>
+fileListJson(const std::string &dir);
+
 /**
  * Ensures that a directory exists, creating it if not.
  */
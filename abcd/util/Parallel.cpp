@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace abcd {
+
+constexpr size_t workersMax = 8;
+constexpr size_t tasksPerWorker = 16;
+
+void
+parallelFor(size_t count, const std::function<void (size_t i)> &task)
+{
+    size_t workers = std::min<size_t>(std::thread::hardware_concurrency(),
+                                      workersMax);
+    workers = std::min(workers, count / tasksPerWorker);
+
+    // Each thread grabs the next unclaimed task until they are gone:
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+            task(i);
+    };
+
+    // The calling thread counts as one of the workers:
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &thread: threads)
+        thread.join();
+}
+
+} // namespace abcd
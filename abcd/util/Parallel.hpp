@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#ifndef ABCD_UTIL_PARALLEL_HPP
+#define ABCD_UTIL_PARALLEL_HPP
+
+#include <stddef.h>
+#include <functional>
+
+namespace abcd {
+
+/**
+ * Runs `task(i)` for every `i` from 0 to `count - 1`,
+ * spreading the work across a bounded number of threads.
+ * Returns once every task has finished.
+ *
+ * The tasks can run in any order, so they should only write to
+ * their own slots in a pre-sized output array.
+ * Small batches just run on the calling thread,
+ * since starting threads would cost more than it saves.
+ */
+void
+parallelFor(size_t count, const std::function<void (size_t i)> &task);
+
+} // namespace abcd
+
+#endif
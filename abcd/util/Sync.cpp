@@ -48,6 +48,83 @@ syncGitError(int e)
     return out;
 }
 
+/**
+ * Looks up the commit a branch points to,
+ * leaving the id zeroed if the branch does not exist yet.
+ */
+static Status
+syncBranchId(git_oid &result, git_repository *repo, const char *name)
+{
+    result = git_oid();
+    int e = git_reference_name_to_id(&result, repo, name);
+    if (e < 0 && GIT_ENOTFOUND != e)
+        ABC_CHECK_GIT(e);
+    return Status();
+}
+
+/**
+ * Reads the tree out of a commit, or gives a null tree (meaning empty)
+ * if the commit id is zero.
+ */
+static Status
+syncCommitTree(AutoFree<git_tree, git_tree_free> &result,
+               git_repository *repo, const git_oid &commitId)
+{
+    if (git_oid_iszero(&commitId))
+        return Status();
+
+    AutoFree<git_commit, git_commit_free> commit;
+    ABC_CHECK_GIT(git_commit_lookup(&commit.get(), repo, &commitId));
+    ABC_CHECK_GIT(git_commit_tree(&result.get(), commit));
+    return Status();
+}
+
+/**
+ * Lists the files that differ between two commits.
+ */
+static Status
+syncDiff(SyncChanges &result, git_repository *repo,
+         const git_oid &fromId, const git_oid &toId)
+{
+    AutoFree<git_tree, git_tree_free> from;
+    AutoFree<git_tree, git_tree_free> to;
+    ABC_CHECK(syncCommitTree(from, repo, fromId));
+    ABC_CHECK(syncCommitTree(to, repo, toId));
+
+    AutoFree<git_diff, git_diff_free> diff;
+    ABC_CHECK_GIT(git_diff_tree_to_tree(&diff.get(), repo, from, to, nullptr));
+
+    SyncChanges out;
+    const size_t size = git_diff_num_deltas(diff);
+    for (size_t i = 0; i < size; ++i)
+    {
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+        if (GIT_DELTA_DELETED == delta->status)
+            out.deleted.insert(delta->old_file.path);
+        else
+            out.changed.insert(delta->new_file.path);
+    }
+
+    result = std::move(out);
+    return Status();
+}
+
+SyncChanges
+SyncChanges::under(const std::string &dir) const
+{
+    const auto prefix = fileSlashify(dir);
+    SyncChanges out;
+
+    for (const auto &path: changed)
+        if (!path.compare(0, prefix.size(), prefix))
+            out.changed.insert(path.substr(prefix.size()));
+    for (const auto &path: deleted)
+        if (!path.compare(0, prefix.size(), prefix))
+            out.deleted.insert(path.substr(prefix.size()));
+
+    return out;
+}
+
 /**
  * Builds a URL for the current git server.
  */
@@ -139,6 +216,14 @@ syncEnsureRepo(const std::string &syncDir, const std::string &tempDir,
 
 Status
 syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty)
+{
+    SyncChanges changes;
+    return syncRepo(syncDir, syncKey, dirty, changes);
+}
+
+Status
+syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty,
+         SyncChanges &changes)
 {
     AutoSyncLock lock(gSyncMutex);
 
@@ -153,9 +238,21 @@ syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty)
         ABC_CHECK_GIT(sync_fetch(repo, url.c_str()));
     }
 
+    git_oid oldMaster;
+    ABC_CHECK(syncBranchId(oldMaster, repo, "refs/heads/master"));
+
     int files_changed, need_push;
     ABC_CHECK_GIT(sync_master(repo, &files_changed, &need_push));
 
+    // The checkout leaves the work directory matching the new master:
+    changes = SyncChanges();
+    if (files_changed)
+    {
+        git_oid newMaster;
+        ABC_CHECK(syncBranchId(newMaster, repo, "refs/heads/master"));
+        ABC_CHECK(syncDiff(changes, repo, oldMaster, newMaster));
+    }
+
     if (need_push)
         ABC_CHECK_GIT(sync_push(repo, url.c_str()));
 
@@ -13,11 +13,29 @@
 #define ABC_Sync_h
 
 #include "Status.hpp"
+#include <set>
 
 #define SYNC_KEY_LENGTH 20
 
 namespace abcd {
 
+/**
+ * The files a sync brought down from the server,
+ * relative to the sync directory.
+ */
+struct SyncChanges
+{
+    std::set<std::string> changed; // Added or modified
+    std::set<std::string> deleted;
+
+    /**
+     * Selects the changes within a subdirectory,
+     * with paths relative to that subdirectory.
+     */
+    SyncChanges
+    under(const std::string &dir) const;
+};
+
 /**
  * Initializes the underlying git library.
  * Should be called at program start.
@@ -60,6 +78,14 @@ syncEnsureRepo(const std::string &syncDir, const std::string &tempDir,
 Status
 syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty);
 
+/**
+ * Same as the above, but also lists the files the sync changed,
+ * so the caller can reload just those.
+ */
+Status
+syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty,
+         SyncChanges &changes);
+
 } // namespace abcd
 
 #endif
@@ -12,8 +12,8 @@
 #include "../json/JsonObject.hpp"
 #include "../util/Debug.hpp"
 #include "../util/FileIO.hpp"
+#include "../util/Sync.hpp"
 #include <bitcoin/bitcoin.hpp>
-#include <dirent.h>
 #include <time.h>
 
 namespace abcd {
@@ -99,12 +99,8 @@ AddressJson::unpack(AddressMeta &result)
     return Status();
 }
 
-static bc::hd_private_key
-mainBranch(const Wallet &wallet)
+AddressDb::~AddressDb()
 {
-    return bc::hd_private_key(wallet.bitcoinKey()).
-           generate_private_key(0).
-           generate_private_key(0);
 }
 
 AddressDb::AddressDb(Wallet &wallet):
@@ -120,33 +116,75 @@ AddressDb::load()
 
     addresses_.clear();
     files_.clear();
+    balancesClear();
 
-    // Open the directory:
-    DIR *dir = opendir(dir_.c_str());
-    if (dir)
+    // Decrypt the files in parallel:
+    std::vector<JsonFile> loaded;
+    for (const auto &name: fileListJson(dir_))
+        loaded.push_back(JsonFile{dir_ + name});
+    jsonLoadFiles(loaded, wallet_.dataKey());
+
+    for (const auto &file: loaded)
     {
-        struct dirent *de;
-        while (nullptr != (de = readdir(dir)))
+        // Try to load the address:
+        AddressMeta address;
+        AddressJson json(file.json);
+        if (file.status.log() && json.unpack(address).log())
         {
-            if (!fileIsJson(de->d_name))
-                continue;
+            if (path(address) != file.path)
+                ABC_DebugLog("Filename %s does not match address",
+                             file.path.c_str());
 
-            // Try to load the address:
-            AddressMeta address;
-            AddressJson json;
-            if (json.load(dir_ + de->d_name, wallet_.dataKey()).log() &&
-                    json.unpack(address).log())
-            {
-                if (path(address) != dir_ + de->d_name)
-                    ABC_DebugLog("Filename %s does not match address", de->d_name);
+            addresses_[address.address] = address;
+            files_[address.address] = json;
+
+            wallet_.cache.addresses.insert(address.address);
+        }
+    }
+
+    ABC_CHECK(stockpile());
+    return Status();
+}
 
-                addresses_[address.address] = address;
-                files_[address.address] = json;
+Status
+AddressDb::loadChanges(const SyncChanges &changes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    balancesClear();
 
-                wallet_.cache.addresses.insert(address.address);
+    // Forget addresses whose files went away:
+    if (!changes.deleted.empty())
+    {
+        for (auto i = addresses_.begin(); i != addresses_.end(); )
+        {
+            if (changes.deleted.count(path(i->second).substr(dir_.size())))
+            {
+                files_.erase(i->first);
+                i = addresses_.erase(i);
+            }
+            else
+            {
+                ++i;
             }
         }
-        closedir(dir);
+    }
+
+    // Load the new or modified files:
+    for (const auto &name: changes.changed)
+    {
+        if (!fileIsJson(name))
+            continue;
+
+        AddressMeta address;
+        AddressJson json;
+        if (json.load(dir_ + name, wallet_.dataKey()).log() &&
+                json.unpack(address).log())
+        {
+            addresses_[address.address] = address;
+            files_[address.address] = json;
+
+            wallet_.cache.addresses.insert(address.address);
+        }
     }
 
     ABC_CHECK(stockpile());
@@ -179,14 +217,53 @@ AddressDb::balance(const TxInfo &info) const
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
+    const auto i = balances_.find(info.txid);
+    if (balances_.end() != i)
+        return i->second;
+
     int64_t out = 0;
     for (const auto &io: info.ios)
         if (addresses_.count(io.address))
             out += io.input ? -io.value : io.value;
 
+    balances_[info.txid] = out;
+    balanceIndex_.insert(info.txid, {std::to_string(out)});
     return out;
 }
 
+std::set<std::string>
+AddressDb::balanceSearch(const std::string &query)
+{
+    // The cache calls happen outside our lock,
+    // since the cache callbacks can call back into us:
+    size_t generation;
+    const auto revision = wallet_.cache.addresses.txidsRevision();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (revision == balanceRevision_)
+            return balanceIndex_.find(query);
+        generation = balanceGeneration_;
+    }
+
+    for (const auto &txid: wallet_.cache.addresses.txids())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (balances_.count(txid))
+                continue;
+        }
+
+        TxInfo info;
+        if (wallet_.cache.txs.info(info, txid))
+            balance(info);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation == balanceGeneration_)
+        balanceRevision_ = revision;
+    return balanceIndex_.find(query);
+}
+
 AddressSet
 AddressDb::list() const
 {
@@ -204,7 +281,7 @@ AddressDb::keyTable()
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto m00 = mainBranch(wallet_);
+    const auto &m00 = branch();
     KeyTable out;
     for (const auto &i: addresses_)
     {
@@ -253,7 +330,7 @@ AddressDb::getNew(AddressMeta &result)
     size_t index = *indices.begin();
 
     // Verify that we can still re-derive the address:
-    auto i = addresses_.find(mainBranch(wallet_).generate_private_key(index).
+    auto i = addresses_.find(branch().generate_private_key(index).
                              address().encoded());
     if (addresses_.end() == i)
         return ABC_ERROR(ABC_CC_Error,
@@ -295,48 +372,88 @@ AddressDb::markOutputs(const TxInfo &info)
 Status
 AddressDb::stockpile()
 {
-    ABC_CHECK(fileEnsureDir(dir_));
-
     // Build a list of used indices:
     std::map<size_t, bool> indices;
     for (const auto &i: addresses_)
         indices[i.second.index] = i.second.recyclable;
 
-    // Check for gaps:
+    // Check for gaps, counting each missing address as if it were there:
+    std::vector<size_t> missing;
+    size_t size = addresses_.size();
     size_t lastUsed = 0;
-    for (size_t i = 0; i < addresses_.size() || i < lastUsed + 5; ++i)
+    for (size_t i = 0; i < size || i < lastUsed + 5; ++i)
     {
         auto index = indices.find(i);
         if (index == indices.end())
         {
-            // Create the missing address:
-            auto m00n = mainBranch(wallet_).generate_private_key(i);
-            if (m00n.valid())
-            {
-                AddressMeta address;
-                address.index = i;
-                address.address = m00n.address().encoded();
-                address.recyclable = true;
-                address.time = time(nullptr);
-                addresses_[address.address] = address;
-
-                AddressJson json;
-                ABC_CHECK(json.pack(address));
-                ABC_CHECK(json.save(path(address), wallet_.dataKey()));
-                files_[address.address] = json;
-
-                wallet_.cache.addresses.insert(address.address);
-            }
+            missing.push_back(i);
+            ++size;
         }
         else if (!index->second)
         {
             lastUsed = i;
         }
     }
+    if (missing.empty())
+        return Status();
+
+    // Derive the whole batch from the cached branch:
+    const auto &m00 = branch();
+    const auto now = time(nullptr);
+    std::vector<AddressMeta> batch;
+    for (auto i: missing)
+    {
+        auto m00n = m00.generate_private_key(i);
+        if (m00n.valid())
+        {
+            AddressMeta address;
+            address.index = i;
+            address.address = m00n.address().encoded();
+            address.recyclable = true;
+            address.time = now;
+            batch.push_back(address);
+        }
+    }
+
+    // Write the batch out:
+    ABC_CHECK(fileEnsureDir(dir_));
+    for (const auto &address: batch)
+    {
+        AddressJson json;
+        ABC_CHECK(json.pack(address));
+        ABC_CHECK(json.save(path(address), wallet_.dataKey()));
+        addresses_[address.address] = address;
+        files_[address.address] = json;
+        balancesClear();
+
+        wallet_.cache.addresses.insert(address.address);
+    }
 
     return Status();
 }
 
+const bc::hd_private_key &
+AddressDb::branch()
+{
+    if (!branch_)
+    {
+        branch_.reset(new bc::hd_private_key(
+                          bc::hd_private_key(wallet_.bitcoinKey()).
+                          generate_private_key(0).
+                          generate_private_key(0)));
+    }
+    return *branch_;
+}
+
+void
+AddressDb::balancesClear()
+{
+    balances_.clear();
+    balanceIndex_.clear();
+    ++balanceGeneration_;
+    balanceRevision_ = 0;
+}
+
 std::string
 AddressDb::path(const AddressMeta &address)
 {
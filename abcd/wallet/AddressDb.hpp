@@ -9,15 +9,19 @@
 #define ABCD_WALLET_ADDRESS_DB_HPP
 
 #include "Metadata.hpp"
+#include "TxSearch.hpp"
 #include "../bitcoin/Typedefs.hpp"
 #include "../json/JsonPtr.hpp"
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
 
 namespace abcd {
 
 class Wallet;
+struct SyncChanges;
 struct TxInfo;
 typedef std::map<const std::string, std::string> KeyTable;
 
@@ -37,6 +41,7 @@ struct AddressMeta
 class AddressDb
 {
 public:
+    ~AddressDb();
     AddressDb(Wallet &wallet);
 
     /**
@@ -45,6 +50,13 @@ public:
     Status
     load();
 
+    /**
+     * Re-reads just the address files that a sync touched.
+     * @param changes File names relative to the addresses directory.
+     */
+    Status
+    loadChanges(const SyncChanges &changes);
+
     /**
      * Updates a particular address in the database.
      */
@@ -53,10 +65,20 @@ public:
 
     /**
      * Calculates the transaction's impact on the wallet balance.
+     * The results are remembered by txid until the address list changes.
      */
     int64_t
     balance(const TxInfo &info) const;
 
+    /**
+     * Finds the transactions whose balance contains the query.
+     * This first fills in the balances for any transactions
+     * that arrived since the last search or address change.
+     * @return A list of txids, which may include dropped transactions.
+     */
+    std::set<std::string>
+    balanceSearch(const std::string &query);
+
     /**
      * Lists all the addresses in the wallet.
      */
@@ -106,14 +128,37 @@ private:
 
     std::map<std::string, AddressMeta> addresses_;
     std::map<std::string, JsonPtr> files_;
+    mutable std::unordered_map<std::string, int64_t> balances_;
+
+    // The remembered balances as text, for searching:
+    mutable TxSearch balanceIndex_;
+    size_t balanceGeneration_ = 0; // Bumped when the balances are cleared
+    size_t balanceRevision_ = 0; // The address cache txids already covered
+    std::unique_ptr<libbitcoin::hd_private_key> branch_;
+
+    /**
+     * Returns the HD branch that holds the wallet's addresses.
+     * Deriving this takes several EC operations, so it only happens once.
+     * Should be called with the mutex held.
+     */
+    const libbitcoin::hd_private_key &
+    branch();
 
     /**
      * Ensures that there are no gaps in the address list,
      * and at there are several extra addresses ready to go.
+     * The missing addresses are derived as one batch before any are saved.
      */
     Status
     stockpile();
 
+    /**
+     * Forgets the remembered balances, since the address list changed.
+     * Should be called with the mutex held.
+     */
+    void
+    balancesClear();
+
     std::string
     path(const AddressMeta &address);
 };
@@ -7,11 +7,13 @@
 
 #include "TxDb.hpp"
 #include "Wallet.hpp"
+#include "../bitcoin/cache/Cache.hpp"
 #include "../crypto/Crypto.hpp"
 #include "../json/JsonObject.hpp"
 #include "../util/Debug.hpp"
 #include "../util/FileIO.hpp"
-#include <dirent.h>
+#include "../util/Sync.hpp"
+#include <sys/stat.h>
 
 namespace abcd {
 
@@ -52,6 +54,50 @@ struct TxJson:
     unpack(TxMeta &result);
 };
 
+/**
+ * One transaction file, as stored in the index.
+ * The stamp tells whether the file has changed since it was indexed.
+ */
+struct TxIndexFileJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(TxIndexFileJson, JsonObject)
+
+    ABC_JSON_INTEGER(size, "size", -1)
+    ABC_JSON_INTEGER(mtime, "mtime", -1)
+    ABC_JSON_INTEGER(mtimeNsec, "mtimeNsec", -1)
+    ABC_JSON_VALUE(tx, "tx", TxJson)
+};
+
+struct TxIndexJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(TxIndexJson, JsonObject)
+
+    ABC_JSON_VALUE(files, "files", JsonObject)
+};
+
+/**
+ * Reads a file's size and modification time into an index entry.
+ */
+static Status
+fileStamp(TxIndexFileJson &result, const std::string &path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info))
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot stat " + path);
+
+#ifdef __APPLE__
+    const auto nsec = info.st_mtimespec.tv_nsec;
+#else
+    const auto nsec = info.st_mtim.tv_nsec;
+#endif
+    ABC_CHECK(result.sizeSet(info.st_size));
+    ABC_CHECK(result.mtimeSet(info.st_mtime));
+    ABC_CHECK(result.mtimeNsecSet(nsec));
+    return Status();
+}
+
 Status
 TxJson::pack(const TxMeta &in, int64_t balance, int64_t fee)
 {
@@ -108,7 +154,8 @@ TxJson::unpack(TxMeta &result)
 
 TxDb::TxDb(const Wallet &wallet):
     wallet_(wallet),
-    dir_(wallet.paths.txsDir())
+    dir_(wallet.paths.txsDir()),
+    indexPath_(wallet.paths.txIndexPath())
 {
 }
 
@@ -117,58 +164,129 @@ TxDb::load()
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    txs_.clear();
+    // Erasing one at a time lets the address cache forget the txids:
+    while (!txs_.empty())
+        erase(txs_.begin()->first);
     files_.clear();
-
-    // Open the directory:
-    DIR *dir = opendir(dir_.c_str());
-    if (dir)
+    search_.clear();
+    byTime_.clear();
+
+    // A missing or damaged index just means more files to decrypt:
+    TxIndexJson index;
+    JsonObject indexFiles;
+    if (index.load(indexPath_, wallet_.dataKey()).log())
+        indexFiles = index.files();
+
+    // Index entries for the files still on disk, by filename:
+    std::map<std::string, TxIndexFileJson> entries;
+    std::vector<JsonFile> stale;
+    bool changed = false;
+
+    // Use the indexed copies for files that haven't changed:
+    for (const auto &name: fileListJson(dir_))
     {
-        struct dirent *de;
-        while (nullptr != (de = readdir(dir)))
+        TxIndexFileJson stamp;
+        if (!fileStamp(stamp, dir_ + name).log())
+            continue;
+
+        TxIndexFileJson entry(indexFiles.getValue(name.c_str()));
+        if (entry && entry.size() == stamp.size() &&
+                entry.mtime() == stamp.mtime() &&
+                entry.mtimeNsec() == stamp.mtimeNsec())
+        {
+            entries[name] = entry;
+        }
+        else
         {
-            if (!fileIsJson(de->d_name))
-                continue;
-
-            // Try to load the address:
-            TxMeta tx;
-            TxJson json;
-            if (json.load(dir_ + de->d_name, wallet_.dataKey()).log() &&
-                    json.unpack(tx).log())
-            {
-                if (path(tx) != dir_ + de->d_name)
-                    ABC_DebugLog("Filename %s does not match transaction", de->d_name);
-
-                // Delete duplicate transactions, if any:
-                auto i = txs_.find(tx.ntxid);
-                if (i != txs_.end())
-                {
-                    if (tx.internal)
-                        fileDelete(path(i->second)).log();
-                    else
-                        fileDelete(dir_ + de->d_name).log();
-                }
-
-                // Save this transaction if is unique or internal:
-                if (i == txs_.end() || tx.internal)
-                {
-                    txs_[tx.ntxid] = tx;
-                    files_[tx.ntxid] = json;
-                }
-            }
+            entries[name] = stamp;
+            stale.push_back(JsonFile{dir_ + name});
         }
-        closedir(dir);
+    }
+
+    // Decrypt the rest in parallel:
+    jsonLoadFiles(stale, wallet_.dataKey());
+    for (const auto &file: stale)
+    {
+        const auto name = file.path.substr(dir_.size());
+        if (!file.status.log() || !entries[name].txSet(file.json).log())
+            entries.erase(name);
+        changed = true;
+    }
+
+    // Merge the results in filename order, so duplicates resolve the same
+    // way every time:
+    std::set<std::string> deleted;
+    for (const auto &entry: entries)
+    {
+        const auto &name = entry.first;
+        TxJson json = entry.second.tx();
+
+        // Try to load the transaction:
+        TxMeta tx;
+        if (!json.unpack(tx).log())
+            continue;
+        if (path(tx) != dir_ + name)
+            ABC_DebugLog("Filename %s does not match transaction", name.c_str());
+
+        const auto duplicate = merge(tx, json, name);
+        if (!duplicate.empty())
+            deleted.insert(duplicate);
+    }
+    for (const auto &name: deleted)
+        entries.erase(name);
+    changed |= !deleted.empty();
+
+    // Write the index back out if any files came or went:
+    if (changed || entries.size() != json_object_size(indexFiles.get()))
+    {
+        JsonObject filesJson;
+        for (const auto &entry: entries)
+            ABC_CHECK(filesJson.set(entry.first.c_str(), entry.second));
+
+        TxIndexJson out;
+        ABC_CHECK(out.filesSet(filesJson));
+        out.save(indexPath_, wallet_.dataKey()).log();
     }
 
     return Status();
 }
 
 Status
-TxDb::save(const TxMeta &tx, int64_t balance, int64_t fee)
+TxDb::loadChanges(const SyncChanges &changes)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    txs_[tx.ntxid] = tx;
+    // Forget transactions whose files went away:
+    if (!changes.deleted.empty())
+    {
+        std::list<std::string> gone;
+        for (const auto &tx: txs_)
+            if (changes.deleted.count(path(tx.second).substr(dir_.size())))
+                gone.push_back(tx.first);
+        for (const auto &ntxid: gone)
+            erase(ntxid);
+    }
+
+    // Load the new or modified files:
+    for (const auto &name: changes.changed)
+    {
+        if (!fileIsJson(name))
+            continue;
+
+        TxMeta tx;
+        TxJson json;
+        if (json.load(dir_ + name, wallet_.dataKey()).log() &&
+                json.unpack(tx).log())
+            merge(tx, json, name);
+    }
+
+    return Status();
+}
+
+Status
+TxDb::save(const TxMeta &tx, int64_t balance, int64_t fee)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
 
     ABC_CHECK(fileEnsureDir(dir_));
     TxJson json(files_[tx.ntxid]);
@@ -176,7 +294,7 @@ TxDb::save(const TxMeta &tx, int64_t balance, int64_t fee)
         json = JsonObject();
     ABC_CHECK(json.pack(tx, balance, fee));
     ABC_CHECK(json.save(path(tx), wallet_.dataKey()));
-    files_[tx.ntxid] = json;
+    insert(tx, json);
 
     return Status();
 }
@@ -194,6 +312,29 @@ TxDb::get(TxMeta &result, const std::string &ntxid)
     return Status();
 }
 
+std::set<std::string>
+TxDb::search(const std::string &query) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return search_.find(query);
+}
+
+bool
+TxDb::older(TxMeta &result, const TxMeta *newer) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto i = newer ?
+             byTime_.lower_bound(TimeKey(newer->timeCreation, newer->ntxid)) :
+             byTime_.end();
+    if (byTime_.begin() == i)
+        return false;
+
+    --i;
+    result = txs_.at(i->second);
+    return true;
+}
+
 int64_t
 TxDb::airbitzFeePending()
 {
@@ -223,6 +364,61 @@ TxDb::airbitzFeeLastSent()
     return out;
 }
 
+void
+TxDb::insert(const TxMeta &tx, const JsonPtr &json)
+{
+    erase(tx.ntxid);
+    txs_[tx.ntxid] = tx;
+    if (!tx.txid.empty())
+    {
+        byTime_.insert(TimeKey(tx.timeCreation, tx.ntxid));
+        wallet_.cache.addresses.txidNamed(tx.txid, true);
+    }
+    files_[tx.ntxid] = json;
+
+    const auto &metadata = tx.metadata;
+    search_.insert(tx.ntxid,
+    {
+        metadata.name, metadata.category, metadata.notes,
+        std::to_string(metadata.amountCurrency)
+    });
+}
+
+void
+TxDb::erase(const std::string &ntxid)
+{
+    auto i = txs_.find(ntxid);
+    if (txs_.end() == i)
+        return;
+
+    byTime_.erase(TimeKey(i->second.timeCreation, ntxid));
+    if (!i->second.txid.empty())
+        wallet_.cache.addresses.txidNamed(i->second.txid, false);
+    txs_.erase(i);
+    files_.erase(ntxid);
+    search_.erase(ntxid);
+}
+
+std::string
+TxDb::merge(const TxMeta &tx, const JsonPtr &json, const std::string &name)
+{
+    // Delete duplicate transactions, if any.
+    // A changed file replacing its own earlier copy is not a duplicate:
+    std::string deleted;
+    auto i = txs_.find(tx.ntxid);
+    if (i != txs_.end() && path(i->second) != dir_ + name)
+    {
+        const auto duplicate = tx.internal ? path(i->second) : dir_ + name;
+        fileDelete(duplicate).log();
+        deleted = duplicate.substr(dir_.size());
+    }
+
+    // Save this transaction if is unique or internal:
+    if (deleted.empty() || tx.internal)
+        insert(tx, json);
+    return deleted;
+}
+
 std::string
 TxDb::path(const TxMeta &tx)
 {
@@ -11,13 +11,16 @@
 #include "../json/JsonPtr.hpp"
 #include "../util/Status.hpp"
 #include "Metadata.hpp"
+#include "TxSearch.hpp"
 #include <map>
 #include <mutex>
+#include <set>
 #include <vector>
 
 namespace abcd {
 
 class Wallet;
+struct SyncChanges;
 
 struct TxMeta
 {
@@ -32,6 +35,11 @@ struct TxMeta
 
 /**
  * Manages the transaction metadata stored in the wallet sync directory.
+ *
+ * Decrypting one file per transaction is slow for large wallets,
+ * so the decrypted files also go into a single encrypted index
+ * outside the sync directory. Each load re-reads only the files
+ * that changed on disk since the index was written.
  */
 class TxDb
 {
@@ -39,11 +47,19 @@ public:
     TxDb(const Wallet &wallet);
 
     /**
-     * Loads the transactions off disk.
+     * Loads the transactions off disk, refreshing the index if needed.
      */
     Status
     load();
 
+    /**
+     * Re-reads just the transaction files that a sync touched.
+     * The index catches up with these on the next full `load`.
+     * @param changes File names relative to the transactions directory.
+     */
+    Status
+    loadChanges(const SyncChanges &changes);
+
     /**
      * Updates a particular transaction in the database.
      * Can also be used to insert new transactions into the database.
@@ -57,6 +73,25 @@ public:
     Status
     get(TxMeta &result, const std::string &ntxid);
 
+    /**
+     * Finds the transactions whose name, category, notes,
+     * or fiat amount contain the query, ignoring case.
+     * @return A list of ntxids.
+     */
+    std::set<std::string>
+    search(const std::string &query) const;
+
+    /**
+     * Steps through the transactions from newest to oldest creation time.
+     * Only transactions with a known txid take part,
+     * and the address cache tracks the live txids these leave out.
+     * @param newer The transaction returned by the previous call,
+     * or nullptr to start with the newest one.
+     * @return false once there are no older transactions.
+     */
+    bool
+    older(TxMeta &result, const TxMeta *newer) const;
+
     /**
      * Determine how many satoshis of unpaid Airbitz fees are in the wallet.
      */
@@ -73,9 +108,39 @@ private:
     mutable std::mutex mutex_;
     const Wallet &wallet_;
     const std::string dir_;
+    const std::string indexPath_;
 
     std::map<std::string, TxMeta> txs_;
     std::map<std::string, JsonPtr> files_;
+    TxSearch search_;
+
+    // Transactions with known txids, sorted by creation time:
+    typedef std::pair<time_t, std::string> TimeKey;
+    std::set<TimeKey> byTime_;
+
+    /**
+     * Puts a transaction in the database, updating the search index.
+     * Should be called with the mutex held.
+     */
+    void
+    insert(const TxMeta &tx, const JsonPtr &json);
+
+    /**
+     * Removes a transaction from the database and the search index.
+     * Should be called with the mutex held.
+     */
+    void
+    erase(const std::string &ntxid);
+
+    /**
+     * Adds a transaction read from a file in the transaction directory.
+     * Duplicate ntxids resolve the same way every time:
+     * internal copies win, and the losing file gets deleted.
+     * Should be called with the mutex held.
+     * @return The name of the deleted file, or an empty string.
+     */
+    std::string
+    merge(const TxMeta &tx, const JsonPtr &json, const std::string &name);
 
     std::string
     path(const TxMeta &tx);
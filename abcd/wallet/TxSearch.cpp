@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "TxSearch.hpp"
+#include <ctype.h>
+
+namespace abcd {
+
+constexpr size_t gramSize = 3;
+
+// Separates the fields, and never appears in a query:
+constexpr char fieldBreak = '\0';
+
+static std::string
+lowercase(const std::string &text)
+{
+    std::string out = text;
+    for (auto &c: out)
+        c = tolower(c);
+    return out;
+}
+
+/**
+ * Lists the grams in a piece of text, skipping field boundaries.
+ */
+static std::set<std::string>
+textGrams(const std::string &text)
+{
+    std::set<std::string> out;
+    for (size_t i = 0; i + gramSize <= text.size(); ++i)
+    {
+        auto gram = text.substr(i, gramSize);
+        if (std::string::npos == gram.find(fieldBreak))
+            out.insert(std::move(gram));
+    }
+    return out;
+}
+
+void
+TxSearch::insert(const std::string &id, const std::list<std::string> &fields)
+{
+    erase(id);
+
+    std::string text;
+    for (const auto &field: fields)
+    {
+        text += lowercase(field);
+        text += fieldBreak;
+    }
+
+    for (const auto &gram: textGrams(text))
+        grams_[gram].insert(id);
+    texts_[id] = std::move(text);
+}
+
+void
+TxSearch::erase(const std::string &id)
+{
+    auto text = texts_.find(id);
+    if (texts_.end() == text)
+        return;
+
+    for (const auto &gram: textGrams(text->second))
+    {
+        auto i = grams_.find(gram);
+        if (grams_.end() == i)
+            continue;
+
+        i->second.erase(id);
+        if (i->second.empty())
+            grams_.erase(i);
+    }
+    texts_.erase(text);
+}
+
+void
+TxSearch::clear()
+{
+    texts_.clear();
+    grams_.clear();
+}
+
+std::set<std::string>
+TxSearch::find(const std::string &query) const
+{
+    std::set<std::string> out;
+    const auto needle = lowercase(query);
+    if (needle.empty())
+        return out;
+
+    // Short queries have no grams, so they need a full scan:
+    if (needle.size() < gramSize)
+    {
+        for (const auto &text: texts_)
+            if (std::string::npos != text.second.find(needle))
+                out.insert(text.first);
+        return out;
+    }
+
+    // Find the gram with the fewest entries:
+    const std::set<std::string> *candidates = nullptr;
+    for (const auto &gram: textGrams(needle))
+    {
+        auto i = grams_.find(gram);
+        if (grams_.end() == i)
+            return out;
+        if (!candidates || i->second.size() < candidates->size())
+            candidates = &i->second;
+    }
+
+    // Every gram matching doesn't mean they are in the right order:
+    for (const auto &id: *candidates)
+        if (std::string::npos != texts_.at(id).find(needle))
+            out.insert(id);
+
+    return out;
+}
+
+} // namespace abcd
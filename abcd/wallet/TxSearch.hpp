@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#ifndef ABCD_WALLET_TX_SEARCH_HPP
+#define ABCD_WALLET_TX_SEARCH_HPP
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+namespace abcd {
+
+/**
+ * A case-insensitive substring index over transaction metadata.
+ *
+ * Each entry's text is split into three-character grams,
+ * and each gram lists the entries that contain it.
+ * A query only needs to check the entries under its rarest gram,
+ * rather than every entry in the wallet.
+ *
+ * This class is not thread-safe, so the owner must provide locking.
+ */
+class TxSearch
+{
+public:
+    /**
+     * Adds or replaces an entry.
+     * A query never matches across the boundary between two fields.
+     */
+    void
+    insert(const std::string &id, const std::list<std::string> &fields);
+
+    void
+    erase(const std::string &id);
+
+    void
+    clear();
+
+    /**
+     * Returns the ids of the entries with a field containing the query.
+     * An empty query matches nothing.
+     */
+    std::set<std::string>
+    find(const std::string &query) const;
+
+private:
+    std::map<std::string, std::string> texts_;
+    std::map<std::string, std::set<std::string> > grams_;
+};
+
+} // namespace abcd
+
+#endif
@@ -168,11 +168,12 @@ Wallet::balanceDirty()
 Status
 Wallet::sync(bool &dirty)
 {
-    ABC_CHECK(syncRepo(paths.syncDir(), syncKey_, dirty));
+    SyncChanges changes;
+    ABC_CHECK(syncRepo(paths.syncDir(), syncKey_, dirty, changes));
     if (dirty)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        ABC_CHECK(loadSync());
+        ABC_CHECK(loadChanges(changes));
     }
 
     return Status();
@@ -186,8 +187,8 @@ Wallet::Wallet(Account &account, const std::string &id):
     balanceDirty_(true),
     addresses(*this),
     txs(*this),
-    cache(*new Cache(paths.cachePath(), gContext->blockCache,
-                     gContext->serverCache))
+    cache(*new Cache(paths.cachePath(), paths.txCachePath(),
+                     gContext->blockCache, gContext->serverCache))
 {}
 
 Status
@@ -255,7 +256,18 @@ Wallet::loadSync()
     ABC_CHECK(fileEnsureDir(gContext->paths.walletsDir()));
     ABC_CHECK(fileEnsureDir(paths.dir()));
     ABC_CHECK(syncEnsureRepo(paths.syncDir(), paths.dir() + "tmp/", syncKey_));
+    loadSettings();
+
+    // Load the databases:
+    ABC_CHECK(addresses.load());
+    ABC_CHECK(txs.load());
 
+    return Status();
+}
+
+void
+Wallet::loadSettings()
+{
     // Load the currency:
     CurrencyJson currencyJson;
     currencyJson.load(paths.currencyPath(), dataKey());
@@ -265,10 +277,18 @@ Wallet::loadSync()
     NameJson json;
     json.load(paths.namePath(), dataKey());
     name_ = json.name();
+}
 
-    // Load the databases:
-    ABC_CHECK(addresses.load());
-    ABC_CHECK(txs.load());
+Status
+Wallet::loadChanges(const SyncChanges &changes)
+{
+    loadSettings();
+
+    const auto syncDir = paths.syncDir();
+    ABC_CHECK(addresses.loadChanges(
+                  changes.under(paths.addressesDir().substr(syncDir.size()))));
+    ABC_CHECK(txs.loadChanges(
+                  changes.under(paths.txsDir().substr(syncDir.size()))));
 
     return Status();
 }
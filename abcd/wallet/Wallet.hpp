@@ -21,6 +21,7 @@ namespace abcd {
 
 class Account;
 class Cache;
+struct SyncChanges;
 
 /**
  * Manages the information stored in the top-level wallet sync directory.
@@ -103,6 +104,19 @@ private:
     Status
     loadSync();
 
+    /**
+     * Reads the small top-level files in the sync directory.
+     */
+    void
+    loadSettings();
+
+    /**
+     * Updates the synced data after a sync,
+     * re-reading only the files that changed.
+     */
+    Status
+    loadChanges(const SyncChanges &changes);
+
 public:
     AddressDb addresses;
     TxDb txs;
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#ifndef BENCH_BENCH_HPP
+#define BENCH_BENCH_HPP
+
+#include "../abcd/util/Status.hpp"
+#include <functional>
+
+/**
+ * Settings shared by all the benchmarks.
+ */
+struct BenchOptions
+{
+    // Synthetic wallet size:
+    size_t txCount = 1000;
+    size_t addressCount = 10000;
+
+    // Number of timed runs per benchmark:
+    unsigned iterations = 5;
+
+    // A real account, for the wallet-level benchmarks:
+    std::string workingDir;
+    std::string username;
+    std::string password;
+    std::string uuid;
+    size_t seedCount = 0;
+};
+
+typedef std::function<abcd::Status ()> BenchFunction;
+
+/**
+ * Times a piece of code, printing the results as a single line of JSON.
+ * @param size The number of items the benchmark works on,
+ * so results from different wallet sizes can be compared.
+ * @param setup Runs before each iteration, outside the timer.
+ */
+abcd::Status
+benchRun(const std::string &name, size_t size, const BenchOptions &options,
+         const BenchFunction &body, const BenchFunction &setup=nullptr);
+
+/**
+ * Measures the bitcoin caches against a synthetic wallet.
+ */
+abcd::Status
+benchCache(const BenchOptions &options);
+
+/**
+ * Measures the wallet databases against a real account.
+ */
+abcd::Status
+benchWallet(const BenchOptions &options);
+
+#endif
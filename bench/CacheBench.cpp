@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/bitcoin/cache/AddressCache.hpp"
+#include "../abcd/bitcoin/cache/BlockCache.hpp"
+#include "../abcd/bitcoin/cache/TxCache.hpp"
+#include "../abcd/bitcoin/Utility.hpp"
+#include "../abcd/bitcoin/spend/Outputs.hpp"
+#include "../abcd/json/JsonObject.hpp"
+#include "../abcd/util/FileIO.hpp"
+#include <stdlib.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+using namespace abcd;
+
+/**
+ * Transactions per spend chain.
+ * The cache walks chains recursively when checking for problems,
+ * so real wallets rarely have long ones.
+ */
+constexpr size_t chainLength = 8;
+
+/**
+ * A wallet's worth of made-up transactions.
+ * Each transaction pays one address and sends change to another,
+ * and spends the change from the transaction before it in its chain.
+ */
+class SyntheticWallet
+{
+public:
+    std::vector<std::string> addresses;
+    std::vector<bc::transaction_type> txs;
+    std::map<std::string, TxidSet> addressTxids;
+    TxidSet txids;
+
+    SyntheticWallet(size_t txCount, size_t addressCount)
+    {
+        // The hashes are made up, since we never sign anything:
+        for (size_t i = 0; i < addressCount; ++i)
+        {
+            bc::payment_address address(bc::payment_address::pubkey_version,
+                                        fakeHash(i));
+            addresses.push_back(address.encoded());
+        }
+
+        // Fake signature and public key:
+        bc::script_type spend;
+        spend.push_operation(makePushOperation(bc::data_chunk(72, 0x30)));
+        spend.push_operation(makePushOperation(bc::data_chunk(33, 0x02)));
+
+        // Every chain starts from an output of this input-less transaction,
+        // so the cache never has to go looking for outside inputs:
+        bc::script_type fundingScript;
+        outputScriptForAddress(fundingScript, addresses[0]);
+        bc::transaction_type funding{1, 0, {}, {}};
+        for (size_t i = 0; i < txCount; i += chainLength)
+            funding.outputs.push_back({100000000, fundingScript});
+        const auto fundingId = add(funding, {addresses[0]});
+
+        bc::hash_digest previous = bc::null_hash;
+        for (size_t i = 0; i < txCount; ++i)
+        {
+            const auto &payee = addresses[i % addressCount];
+            const auto &change = addresses[(7 * i + 1) % addressCount];
+
+            bc::script_type payeeScript, changeScript;
+            outputScriptForAddress(payeeScript, payee);
+            outputScriptForAddress(changeScript, change);
+
+            bc::output_point prevout{previous, 1};
+            if (0 == i % chainLength)
+                prevout = bc::output_point{fundingId, uint32_t(i / chainLength)};
+
+            bc::transaction_type tx
+            {
+                1, 0,
+                {
+                    {prevout, spend, 0xffffffff}
+                },
+                {
+                    {10000 + i, payeeScript},
+                    {50000000 - i, changeScript}
+                }
+            };
+            previous = add(tx, {payee, change});
+        }
+    }
+
+    /**
+     * Puts the wallet's transactions in a cache,
+     * confirming all but the newest few.
+     */
+    void
+    fill(TxCache &cache) const
+    {
+        for (size_t i = 0; i < txs.size(); ++i)
+        {
+            cache.insert(txs[i]);
+            if (i + 10 < txs.size())
+                cache.confirmed(bc::encode_hash(bc::hash_transaction(txs[i])),
+                                100000 + i / 10);
+        }
+    }
+
+private:
+    bc::hash_digest
+    add(const bc::transaction_type &tx, const AddressSet &related)
+    {
+        const auto hash = bc::hash_transaction(tx);
+        const auto txid = bc::encode_hash(hash);
+
+        txs.push_back(tx);
+        txids.insert(txid);
+        for (const auto &address: related)
+            addressTxids[address].insert(txid);
+        return hash;
+    }
+
+    static bc::short_hash
+    fakeHash(size_t i)
+    {
+        bc::short_hash out{};
+        for (size_t b = 0; b < sizeof(i) && b < out.size(); ++b)
+            out[b] = (i >> (8 * b)) & 0xff;
+        return out;
+    }
+};
+
+Status
+benchCache(const BenchOptions &options)
+{
+    char dirTemplate[] = "/tmp/abc-bench-XXXXXX";
+    if (!mkdtemp(dirTemplate))
+        return ABC_ERROR(ABC_CC_DirReadError, "Cannot create temporary directory");
+    const auto dir = fileSlashify(dirTemplate);
+    const auto txsPath = dir + "txs.bin";
+
+    const SyntheticWallet wallet(options.txCount, options.addressCount);
+    const AddressSet addresses(wallet.addresses.begin(), wallet.addresses.end());
+    const auto txCount = options.txCount;
+    const auto addressCount = options.addressCount;
+    BlockCache blocks(dir + "blocks.json");
+    std::unique_ptr<TxCache> txCache;
+
+    // TxCache -------------------------------------------------------------
+
+    ABC_CHECK(benchRun("TxCache::save", txCount, options,
+                       [&]() -> Status
+    {
+        return txCache->save();
+    },
+    [&]() -> Status
+    {
+        ABC_CHECK(fileDelete(txsPath));
+        txCache.reset(new TxCache(blocks, txsPath));
+        wallet.fill(*txCache);
+        return Status();
+    }));
+
+    ABC_CHECK(benchRun("TxCache::load", txCount, options,
+                       [&]() -> Status
+    {
+        return txCache->load();
+    },
+    [&]() -> Status
+    {
+        txCache.reset(new TxCache(blocks, txsPath));
+        return Status();
+    }));
+
+    ABC_CHECK(benchRun("TxCache::statuses", txCount, options,
+                       [&]() -> Status
+    {
+        const auto statuses = txCache->statuses(wallet.txids);
+        if (statuses.size() != wallet.txs.size())
+            return ABC_ERROR(ABC_CC_Error, "Wrong transaction count");
+        return Status();
+    }));
+
+    ABC_CHECK(benchRun("TxCache::utxos", addressCount, options,
+                       [&]() -> Status
+    {
+        const auto utxos = txCache->utxos(addresses);
+        if (utxos.empty())
+            return ABC_ERROR(ABC_CC_Error, "No utxos");
+        return Status();
+    }));
+
+    // AddressCache --------------------------------------------------------
+
+    std::unique_ptr<AddressCache> addressCache;
+    JsonObject addressJson;
+
+    ABC_CHECK(benchRun("AddressCache::update", addressCount, options,
+                       [&]() -> Status
+    {
+        for (const auto &address: wallet.addresses)
+        {
+            const auto i = wallet.addressTxids.find(address);
+            addressCache->update(address, wallet.addressTxids.end() == i ?
+                                 TxidSet() : i->second);
+        }
+        return Status();
+    },
+    [&]() -> Status
+    {
+        addressCache.reset(new AddressCache(*txCache));
+        for (const auto &address: wallet.addresses)
+            addressCache->insert(address);
+        return Status();
+    }));
+    ABC_CHECK(addressCache->save(addressJson));
+
+    ABC_CHECK(benchRun("AddressCache::load", addressCount, options,
+                       [&]() -> Status
+    {
+        return addressCache->load(addressJson);
+    },
+    [&]() -> Status
+    {
+        addressCache.reset(new AddressCache(*txCache));
+        return Status();
+    }));
+
+    ABC_CHECK(benchRun("AddressCache::statuses", addressCount, options,
+                       [&]() -> Status
+    {
+        time_t sleep;
+        addressCache->statuses(sleep);
+        return Status();
+    }));
+
+    addressCache.reset();
+    txCache.reset();
+    ABC_CHECK(fileDelete(dir));
+
+    return Status();
+}
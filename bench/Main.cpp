@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/json/JsonObject.hpp"
+#include <getopt.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace abcd;
+
+/**
+ * One line of benchmark output.
+ */
+struct BenchJson:
+    public JsonObject
+{
+    ABC_JSON_STRING(name, "name", "")
+    ABC_JSON_INTEGER(size, "size", 0)
+    ABC_JSON_INTEGER(iterations, "iterations", 0)
+    ABC_JSON_NUMBER(min, "minMs", 0)
+    ABC_JSON_NUMBER(mean, "meanMs", 0)
+    ABC_JSON_NUMBER(max, "maxMs", 0)
+};
+
+Status
+benchRun(const std::string &name, size_t size, const BenchOptions &options,
+         const BenchFunction &body, const BenchFunction &setup)
+{
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    double min = 0, max = 0, total = 0;
+    for (unsigned i = 0; i < options.iterations; ++i)
+    {
+        if (setup)
+            ABC_CHECK(setup());
+
+        const auto start = std::chrono::steady_clock::now();
+        ABC_CHECK(body());
+        const auto end = std::chrono::steady_clock::now();
+
+        const double ms = Milliseconds(end - start).count();
+        min = i ? std::min(min, ms) : ms;
+        max = i ? std::max(max, ms) : ms;
+        total += ms;
+    }
+
+    BenchJson json;
+    ABC_CHECK(json.nameSet(name));
+    ABC_CHECK(json.sizeSet(size));
+    ABC_CHECK(json.iterationsSet(options.iterations));
+    ABC_CHECK(json.minSet(min));
+    ABC_CHECK(json.meanSet(options.iterations ? total / options.iterations : 0));
+    ABC_CHECK(json.maxSet(max));
+    std::cout << json.encode(true) << std::endl;
+
+    return Status();
+}
+
+static void
+usage()
+{
+    std::cerr <<
+              "usage: abc-bench [options]\n"
+              "  -t, --txs <n>          Synthetic transaction count (default 1000)\n"
+              "  -a, --addresses <n>    Synthetic address count (default 10000)\n"
+              "  -i, --iterations <n>   Timed runs per benchmark (default 5)\n"
+              "  -d, --working-dir <d>  Core directory, for the wallet benchmarks\n"
+              "  -u, --username <u>     Account username\n"
+              "  -p, --password <p>     Account password\n"
+              "  -w, --wallet <id>      Wallet id\n"
+              "  -s, --seed <n>         Add n synthetic transactions to the wallet\n"
+              "                         (only use this with a throwaway account)\n"
+              "Results go to stdout, one JSON object per line." << std::endl;
+}
+
+/**
+ * The main program body.
+ */
+static Status run(int argc, char *argv[])
+{
+    BenchOptions options;
+
+    static const struct option long_options[] =
+    {
+        {"txs",         required_argument, nullptr, 't'},
+        {"addresses",   required_argument, nullptr, 'a'},
+        {"iterations",  required_argument, nullptr, 'i'},
+        {"working-dir", required_argument, nullptr, 'd'},
+        {"username",    required_argument, nullptr, 'u'},
+        {"password",    required_argument, nullptr, 'p'},
+        {"wallet",      required_argument, nullptr, 'w'},
+        {"seed",        required_argument, nullptr, 's'},
+        {"help",        no_argument,       nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int c;
+    while (-1 != (c = getopt_long(argc, argv,
+                                  "t:a:i:d:u:p:w:s:h",
+                                  long_options,
+                                  nullptr)))
+    {
+        switch (c)
+        {
+        case 't':
+            options.txCount = strtoul(optarg, nullptr, 10);
+            break;
+        case 'a':
+            options.addressCount = strtoul(optarg, nullptr, 10);
+            break;
+        case 'i':
+            options.iterations = strtoul(optarg, nullptr, 10);
+            break;
+        case 'd':
+            options.workingDir = optarg;
+            break;
+        case 'u':
+            options.username = optarg;
+            break;
+        case 'p':
+            options.password = optarg;
+            break;
+        case 'w':
+            options.uuid = optarg;
+            break;
+        case 's':
+            options.seedCount = strtoul(optarg, nullptr, 10);
+            break;
+        case 'h':
+            usage();
+            return Status();
+        default:
+            usage();
+            return ABC_ERROR(ABC_CC_Error, "Bad command-line options");
+        }
+    }
+    if (!options.txCount || !options.addressCount || !options.iterations)
+        return ABC_ERROR(ABC_CC_Error, "Sizes must be greater than zero");
+
+    ABC_CHECK(benchCache(options));
+    if (!options.workingDir.empty())
+        ABC_CHECK(benchWallet(options));
+
+    return Status();
+}
+
+int main(int argc, char *argv[])
+{
+    Status s = run(argc, argv);
+    if (!s)
+        std::cerr << s << std::endl;
+    return s ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/login/json/KeyJson.hpp"
+#include "../abcd/login/server/LoginServer.hpp"
+#include "../abcd/util/FileIO.hpp"
+#include "../abcd/wallet/Wallet.hpp"
+#include "../src/LoginShim.hpp"
+#include "../src/TxInfo.hpp"
+#include <bitcoin/bitcoin.hpp>
+#include <dirent.h>
+
+using namespace abcd;
+
+#define CA_CERT "./cli/ca-certificates.crt"
+
+/**
+ * Counts the JSON files in a sync directory.
+ */
+static size_t
+jsonCount(const std::string &path)
+{
+    size_t out = 0;
+    DIR *dir = opendir(path.c_str());
+    if (dir)
+    {
+        struct dirent *de;
+        while (nullptr != (de = readdir(dir)))
+            if (fileIsJson(de->d_name))
+                ++out;
+        closedir(dir);
+    }
+    return out;
+}
+
+/**
+ * Adds made-up transaction metadata to the wallet.
+ * This gets synced like any other change,
+ * so it should only ever touch a throwaway account.
+ */
+static Status
+seedWallet(Wallet &wallet, size_t count)
+{
+    const auto now = time(nullptr);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto label = "abc-bench " + std::to_string(i);
+
+        TxMeta tx;
+        tx.ntxid = bc::encode_hash(bc::bitcoin_hash(bc::to_data_chunk(label)));
+        tx.txid = tx.ntxid;
+        tx.timeCreation = now - 60 * i;
+        tx.internal = true;
+        tx.metadata.name = label;
+        ABC_CHECK(wallet.txs.save(tx, 0, 0));
+    }
+
+    return Status();
+}
+
+Status
+benchWallet(const BenchOptions &options)
+{
+    unsigned char seed[] = {1, 2, 3};
+    ABC_CHECK_OLD(ABC_Initialize(options.workingDir.c_str(),
+                                 CA_CERT,
+                                 "",
+                                 repoTypeAirbitzAccount,
+                                 "",
+                                 seed,
+                                 sizeof(seed),
+                                 &error));
+
+    std::shared_ptr<Login> login;
+    AuthError authError;
+    ABC_CHECK(cacheLoginPassword(login, options.username.c_str(),
+                                 options.password, authError));
+
+    std::shared_ptr<Wallet> wallet;
+    ABC_CHECK(cacheWallet(wallet, options.username.c_str(),
+                          options.uuid.c_str()));
+    ABC_CHECK(seedWallet(*wallet, options.seedCount));
+
+    ABC_CHECK(benchRun("TxDb::load", jsonCount(wallet->paths.txsDir()), options,
+                       [&]() -> Status
+    {
+        return wallet->txs.load();
+    }));
+
+    ABC_CHECK(benchRun("AddressDb::load",
+                       jsonCount(wallet->paths.addressesDir()), options,
+                       [&]() -> Status
+    {
+        return wallet->addresses.load();
+    }));
+
+    // The transaction list comes from the cache, so count it first:
+    unsigned int count = 0;
+    {
+        tABC_TxInfo **txs = nullptr;
+        ABC_CHECK_OLD(ABC_TxGetTransactions(*wallet,
+                                            ABC_GET_TX_ALL_TIMES,
+                                            ABC_GET_TX_ALL_TIMES,
+                                            &txs, &count, &error));
+        ABC_TxFreeTransactions(txs, count);
+    }
+
+    ABC_CHECK(benchRun("ABC_TxGetTransactions", count, options,
+                       [&]() -> Status
+    {
+        tABC_TxInfo **txs = nullptr;
+        unsigned int size = 0;
+        ABC_CHECK_OLD(ABC_TxGetTransactions(*wallet,
+                                            ABC_GET_TX_ALL_TIMES,
+                                            ABC_GET_TX_ALL_TIMES,
+                                            &txs, &size, &error));
+        ABC_TxFreeTransactions(txs, size);
+        return Status();
+    }));
+
+    wallet.reset();
+    login.reset();
+    ABC_Terminate();
+    return Status();
+}
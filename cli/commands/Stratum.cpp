@@ -9,6 +9,7 @@
 #include "../../abcd/bitcoin/network/StratumConnection.hpp"
 #include <zmq.h>
 #include <iostream>
+#include <vector>
 
 using namespace abcd;
 
@@ -24,7 +25,7 @@ COMMAND(InitLevel::context, CliStratumVersion, "stratum-version",
     // Connect to the server:
     StratumConnection c;
     ABC_CHECK(c.connect(uri));
-    std::cout << "Connection established" << std::endl;
+    std::cout << "Connecting" << std::endl;
 
     // Send the version command:
     auto onError = [](Status status)
@@ -48,12 +49,10 @@ COMMAND(InitLevel::context, CliStratumVersion, "stratum-version",
         if (1 <= done)
             break;
 
-        zmq_pollitem_t pollitem =
-        {
-            nullptr, c.pollfd(), ZMQ_POLLIN, ZMQ_POLLOUT
-        };
+        const auto list = c.pollitems();
+        std::vector<zmq_pollitem_t> pollitems(list.begin(), list.end());
         long timeout = sleep.count() ? sleep.count() : -1;
-        zmq_poll(&pollitem, 1, timeout);
+        zmq_poll(pollitems.data(), pollitems.size(), timeout);
     }
 
     return Status();
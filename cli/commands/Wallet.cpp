@@ -14,6 +14,8 @@
 #include "../../abcd/util/Util.hpp"
 #include "../../abcd/wallet/Wallet.hpp"
 #include "../../src/LoginShim.hpp"
+#include <fcntl.h>
+#include <unistd.h>
 #include <iostream>
 
 using namespace abcd;
@@ -56,14 +58,23 @@ COMMAND(InitLevel::wallet, CliWalletExport, "wallet-csv",
         return ABC_ERROR(ABC_CC_Error, helpString(*this));
     const auto filename = argv[0];
 
-    AutoString csvFile;
-    ABC_CHECK_OLD(ABC_CsvExport(session.username.c_str(),
-                                session.password.c_str(),
-                                session.uuid.c_str(),
-                                0, 0,
-                                &csvFile.get(),
-                                &error));
-    ABC_CHECK(fileSave(std::string(csvFile), filename));
+    const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return ABC_ERROR(ABC_CC_FileOpenError,
+                         std::string("Cannot open ") + filename);
+
+    const char *uuids[] = {session.uuid.c_str()};
+    tABC_Error error;
+    ABC_ExportTransactions(session.username.c_str(),
+                           session.password.c_str(),
+                           uuids, 1,
+                           0, 0,
+                           ABC_ExportFormatCsv,
+                           fd,
+                           &error);
+    close(fd);
+    if (ABC_CC_Ok != error.code)
+        return Status::fromError(error, ABC_HERE());
     return Status();
 }
 
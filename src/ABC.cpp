@@ -144,6 +144,9 @@ void ABC_Terminate()
     if (gContext)
     {
         ABC_ClearKeyCache(NULL);
+
+        // Background work still needs the context:
+        gContext->exchangeCache.stop();
         gContext.reset();
 
         syncTerminate();
@@ -2158,6 +2161,44 @@ exit:
     return cc;
 }
 
+/**
+ * Gets one page of the transactions associated with the given wallet,
+ * newest first.
+ *
+ * @param szUserName        UserName for the account associated with the transactions
+ * @param szPassword        Password for the account associated with the transactions
+ * @param szWalletUUID      UUID of the wallet associated with the transactions
+ * @param offset            Number of matching transactions to skip
+ * @param limit             Maximum number of transactions to return
+ * @param paTransactions    Pointer to store array of transactions info pointers
+ * @param pCount            Pointer to store number of transactions
+ * @param pError            A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_GetTransactionsPage(const char *szUserName,
+                                const char *szPassword,
+                                const char *szWalletUUID,
+                                int64_t startTime,
+                                int64_t endTime,
+                                unsigned int offset,
+                                unsigned int limit,
+                                tABC_TxInfo ***paTransactions,
+                                unsigned int *pCount,
+                                tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+
+    {
+        ABC_GET_WALLET();
+        ABC_CHECK_RET(ABC_TxGetTransactionsPage(*wallet, startTime, endTime,
+                                                offset, limit,
+                                                paTransactions, pCount,
+                                                pError));
+    }
+
+exit:
+    return cc;
+}
+
 /**
  * Searches the transactions associated with the given wallet.
  *
@@ -3179,7 +3220,8 @@ exit:
 }
 
 /**
- * Request an update to the exchange for a currency
+ * Request an update to the exchange for a currency.
+ * This only blocks if there is no usable rate in the cache yet.
  */
 tABC_CC
 ABC_RequestExchangeRateUpdate(const char *szUserName,
@@ -3205,8 +3247,8 @@ ABC_RequestExchangeRateUpdate(const char *szUserName,
         sources.remove(preference);
         sources.push_front(preference);
 
-        // Do the update:
-        ABC_CHECK_NEW(gContext->exchangeCache.update(currencies, sources));
+        // Do the update, in the background if we already have a rate:
+        ABC_CHECK_NEW(gContext->exchangeCache.refresh(currencies, sources));
     }
 
 exit:
@@ -3243,6 +3285,39 @@ tABC_CC ABC_Version(char **szVersion, tABC_Error *pError)
     return cc;
 }
 
+/**
+ * Streams the transactions from several wallets into one export.
+ */
+static Status
+exportWallets(ExportWriter &writer, const char *szUserName,
+              const std::vector<std::string> &uuids,
+              int64_t startTime, int64_t endTime)
+{
+    for (size_t i = 0; i < uuids.size(); ++i)
+    {
+        std::shared_ptr<Wallet> wallet;
+        ABC_CHECK(cacheWallet(wallet, szUserName, uuids[i].c_str()));
+
+        std::string currency;
+        ABC_CHECK(currencyCode(currency,
+                               static_cast<Currency>(wallet->currency())));
+        if (!i)
+            ABC_CHECK(writer.begin(currency));
+
+        ABC_CHECK(forEachTxInfo(*wallet, startTime, endTime,
+                                [&](const tABC_TxInfo &tx)
+        {
+            return writer.write(tx, currency);
+        }));
+    }
+
+    if (!writer.count())
+        return ABC_ERROR(ABC_CC_NoTransaction, "No transactions to export");
+    ABC_CHECK(writer.end());
+
+    return Status();
+}
+
 tABC_CC ABC_CsvExport(const char *szUserName, /* DEPRECATED */
                       const char *szPassword, /* DEPRECATED */
                       const char *szWalletUUID,
@@ -3251,27 +3326,23 @@ tABC_CC ABC_CsvExport(const char *szUserName, /* DEPRECATED */
                       char **szCsvData,
                       tABC_Error *pError)
 {
-    tABC_TxInfo **paTransactions = nullptr;
-    unsigned int count = 0;
     ABC_PROLOG();
+    ABC_CHECK_NULL(szWalletUUID);
 
     {
-        ABC_GET_WALLET();
-
-        ABC_CHECK_RET(ABC_TxGetTransactions(*wallet, startTime, endTime,
-                                            &paTransactions, &count, pError));
-        ABC_CHECK_ASSERT(0 != count, ABC_CC_NoTransaction, "No transactions to export");
-
-        std::string currency;
-        ABC_CHECK_NEW(currencyCode(currency,
-                                   static_cast<Currency>(wallet->currency())));
-
-        ABC_CHECK_RET(ABC_ExportFormatCsv(paTransactions, count, szCsvData, pError,
-                                          currency));
+        std::string out;
+        ExportWriter writer(ExportFormat::csv,
+                            [&](const std::string &data) -> Status
+        {
+            out += data;
+            return Status();
+        });
+        ABC_CHECK_NEW(exportWallets(writer, szUserName, {szWalletUUID},
+                                    startTime, endTime));
+        *szCsvData = stringCopy(out);
     }
 
 exit:
-    ABC_FreeTransactions(paTransactions, count);
     return cc;
 }
 
@@ -3283,27 +3354,56 @@ tABC_CC ABC_QBOExport(const char *szUserName, /* DEPRECATED */
                       char **szQBOData,
                       tABC_Error *pError)
 {
-    tABC_TxInfo **paTransactions = nullptr;
-    unsigned int count = 0;
     ABC_PROLOG();
+    ABC_CHECK_NULL(szWalletUUID);
 
     {
-        ABC_GET_WALLET();
-
-        ABC_CHECK_RET(ABC_TxGetTransactions(*wallet, startTime, endTime,
-                                            &paTransactions, &count, pError));
-        ABC_CHECK_ASSERT(0 != count, ABC_CC_NoTransaction, "No transactions to export");
-
-        std::string currency;
-        ABC_CHECK_NEW(currencyCode(currency,
-                                   static_cast<Currency>(wallet->currency())));
         std::string out;
-        ABC_CHECK_NEW(exportFormatQBO(out, paTransactions, count, currency));
+        ExportWriter writer(ExportFormat::qbo,
+                            [&](const std::string &data) -> Status
+        {
+            out += data;
+            return Status();
+        });
+        ABC_CHECK_NEW(exportWallets(writer, szUserName, {szWalletUUID},
+                                    startTime, endTime));
         *szQBOData = stringCopy(out);
     }
 
 exit:
-    ABC_FreeTransactions(paTransactions, count);
+    return cc;
+}
+
+tABC_CC ABC_ExportTransactions(const char *szUserName,
+                               const char *szPassword,
+                               const char **aszWalletUUIDs,
+                               unsigned int walletCount,
+                               int64_t startTime,
+                               int64_t endTime,
+                               tABC_ExportFormat format,
+                               int fd,
+                               tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(aszWalletUUIDs);
+    ABC_CHECK_ASSERT(0 != walletCount, ABC_CC_Error, "No wallets to export");
+
+    {
+        std::vector<std::string> uuids;
+        for (unsigned i = 0; i < walletCount; ++i)
+        {
+            ABC_CHECK_NULL(aszWalletUUIDs[i]);
+            uuids.push_back(aszWalletUUIDs[i]);
+        }
+
+        ExportWriter writer(ABC_ExportFormatQbo == format ?
+                            ExportFormat::qbo : ExportFormat::csv,
+                            exportSinkFd(fd));
+        ABC_CHECK_NEW(exportWallets(writer, szUserName, uuids,
+                                    startTime, endTime));
+    }
+
+exit:
     return cc;
 }
 
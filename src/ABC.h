@@ -208,6 +208,15 @@ typedef enum eABC_SpendFeeLevel
     ABC_SpendFeeLevelCustom,
 } tABC_SpendFeeLevel;
 
+/**
+ * Transaction export file formats.
+ */
+typedef enum eABC_ExportFormat
+{
+    ABC_ExportFormatCsv = 0,
+    ABC_ExportFormatQbo,
+} tABC_ExportFormat;
+
 /**
  * AirBitz Core Asynchronous Structure
  *
@@ -1201,6 +1210,23 @@ tABC_CC ABC_QBOExport(const char *szUserName,
                       char **szQBOData,
                       tABC_Error *pError);
 
+/**
+ * Writes the transactions from one or more wallets to a file descriptor,
+ * one row at a time, without building the whole export in memory.
+ * The fiat amount column takes its name from the first wallet's currency.
+ * @param aszWalletUUIDs The wallets to export, in order.
+ * @param fd An open file descriptor. The caller closes it.
+ */
+tABC_CC ABC_ExportTransactions(const char *szUserName,
+                               const char *szPassword,
+                               const char **aszWalletUUIDs,
+                               unsigned int walletCount,
+                               int64_t startTime,
+                               int64_t endTime,
+                               tABC_ExportFormat format,
+                               int fd,
+                               tABC_Error *pError);
+
 tABC_CC ABC_DataSyncWallet(const char *szUserName,
                            const char *szPassword,
                            const char *szWalletUUID,
@@ -1366,6 +1392,25 @@ tABC_CC ABC_GetTransactions(const char *szUserName,
                             unsigned int *pCount,
                             tABC_Error *pError);
 
+/**
+ * Gets one page of a wallet's transactions, newest first,
+ * without building the whole transaction list.
+ * @param startTime, endTime The time range to list,
+ * or ABC_GET_TX_ALL_TIMES for everything.
+ * @param offset The number of matching transactions to skip.
+ * @param limit The maximum number of transactions to return.
+ */
+tABC_CC ABC_GetTransactionsPage(const char *szUserName,
+                                const char *szPassword,
+                                const char *szWalletUUID,
+                                int64_t startTime,
+                                int64_t endTime,
+                                unsigned int offset,
+                                unsigned int limit,
+                                tABC_TxInfo ***paTransactions,
+                                unsigned int *pCount,
+                                tABC_Error *pError);
+
 tABC_CC ABC_SearchTransactions(const char *szUserName,
                                const char *szPassword,
                                const char *szWalletUUID,
@@ -10,14 +10,31 @@
 #include "../abcd/bitcoin/cache/Cache.hpp"
 #include "../abcd/wallet/Wallet.hpp"
 #include "../abcd/util/Util.hpp"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <vector>
 
 namespace abcd {
 
 static void     ABC_TxFreeOutputs(tABC_TxOutput **aOutputs, unsigned int count);
 static int      ABC_TxInfoPtrCompare (const void *a, const void *b);
-static void     ABC_TxStrTable(const char *needle, int *table);
-static int      ABC_TxStrStr(const char *haystack, const char *needle,
-                             tABC_Error *pError);
+
+/**
+ * Best-effort timestamp for a transaction.
+ * The block time wins if it is earlier than the metadata time,
+ * which happens when a wallet first learns about an old transaction.
+ */
+static time_t
+txTime(Wallet &self, const TxStatus &status, const TxMeta *meta)
+{
+    time_t timestamp = time(nullptr);
+    if (status.height)
+        self.cache.blocks.headerTime(timestamp, status.height);
+
+    return meta ? std::min(timestamp, meta->timeCreation) : timestamp;
+}
 
 tABC_TxInfo *
 makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status)
@@ -42,23 +59,18 @@ makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status)
         out->aOutputs[i++] = txo;
     }
 
-    // Best-effort timestamp:
-    time_t timestamp = time(nullptr);
-    if (status.height)
-        self.cache.blocks.headerTime(timestamp, status.height);
-
     // Details:
     TxMeta meta;
     if (self.txs.get(meta, info.ntxid))
     {
-        out->timeCreation = std::min(timestamp, meta.timeCreation);
+        out->timeCreation = txTime(self, status, &meta);
         out->airbitzFeeWanted = meta.airbitzFeeWanted;
         out->airbitzFeeSent = meta.airbitzFeeSent;
         out->pDetails = meta.metadata.toDetails();
     }
     else
     {
-        out->timeCreation = timestamp;
+        out->timeCreation = txTime(self, status, nullptr);
         out->airbitzFeeWanted = 0;
         out->airbitzFeeSent = 0;
         out->pDetails = Metadata().toDetails();
@@ -75,6 +87,47 @@ makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status)
     return out;
 }
 
+Status
+forEachTxInfo(Wallet &self, int64_t startTime, int64_t endTime,
+              const TxInfoVisitor &visitor)
+{
+    const bool allTimes = endTime == ABC_GET_TX_ALL_TIMES;
+
+    // Sort just the timestamps, since the full structures are big:
+    std::vector<std::pair<time_t, std::string>> order;
+    for (const auto &txid: self.cache.addresses.txids())
+    {
+        TxInfo info;
+        TxStatus status;
+        if (!self.cache.txs.info(info, txid) ||
+                !self.cache.txs.status(status, txid))
+            continue;
+
+        TxMeta meta;
+        const auto time = self.txs.get(meta, info.ntxid) ?
+                          txTime(self, status, &meta) :
+                          txTime(self, status, nullptr);
+        if (allTimes || (startTime <= time && time < endTime))
+            order.push_back(std::make_pair(time, txid));
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    for (const auto &item: order)
+    {
+        TxInfo info;
+        TxStatus status;
+        if (!self.cache.txs.info(info, item.second) ||
+                !self.cache.txs.status(status, item.second))
+            continue;
+
+        AutoFree<tABC_TxInfo, ABC_TxFreeTransaction>
+        tx(makeTxInfo(self, info, status));
+        ABC_CHECK(visitor(*tx.get()));
+    }
+
+    return Status();
+}
+
 /**
  * Gets the transactions associated with the given wallet.
  *
@@ -145,25 +198,39 @@ exit:
 }
 
 /**
- * Searches transactions associated with the given wallet.
+ * Gets one page of the transactions associated with the given wallet,
+ * newest first.
  *
- * @param szQuery           Query to search
+ * The metadatabase keeps the transactions sorted by creation time,
+ * which is never earlier than the final timestamp,
+ * so the walk can stop as soon as the page is certain to be full.
+ * Live transactions the walk cannot reach are merged in up front.
+ *
+ * @param startTime         Return transactions after this time
+ * @param endTime           Return transactions before this time
+ * @param offset            Number of matching transactions to skip
+ * @param limit             Maximum number of transactions to return
  * @param paTransactions    Pointer to store array of transactions info pointers
  * @param pCount            Pointer to store number of transactions
  * @param pError            A pointer to the location to store the error if there is one
  */
-tABC_CC ABC_TxSearchTransactions(Wallet &self,
-                                 const char *szQuery,
-                                 tABC_TxInfo ***paTransactions,
-                                 unsigned int *pCount,
-                                 tABC_Error *pError)
+tABC_CC ABC_TxGetTransactionsPage(Wallet &self,
+                                  int64_t startTime,
+                                  int64_t endTime,
+                                  unsigned int offset,
+                                  unsigned int limit,
+                                  tABC_TxInfo ***paTransactions,
+                                  unsigned int *pCount,
+                                  tABC_Error *pError)
 {
     tABC_CC cc = ABC_CC_Ok;
     tABC_TxInfo **aTransactions = NULL;
-    tABC_TxInfo **aSearchTransactions = NULL;
-    unsigned int i;
     unsigned int count = 0;
-    unsigned int matchCount = 0;
+    const bool allTimes = endTime == ABC_GET_TX_ALL_TIMES;
+    const size_t wanted = size_t(offset) + limit;
+
+    // Candidates for the page, newest first:
+    std::multimap<time_t, std::string, std::greater<time_t>> best;
 
     ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
     ABC_CHECK_NULL(paTransactions);
@@ -171,60 +238,170 @@ tABC_CC ABC_TxSearchTransactions(Wallet &self,
     ABC_CHECK_NULL(pCount);
     *pCount = 0;
 
-    ABC_TxGetTransactions(self, ABC_GET_TX_ALL_TIMES, ABC_GET_TX_ALL_TIMES,
-                          &aTransactions, &count, pError);
-    ABC_ARRAY_NEW(aSearchTransactions, count, tABC_TxInfo *);
-    for (i = 0; i < count; i++)
+    if (limit)
     {
-        tABC_TxInfo *pInfo = aTransactions[i];
-        auto satoshi = std::to_string(pInfo->pDetails->amountSatoshi);
-        auto currency = std::to_string(pInfo->pDetails->amountCurrency);
-        if (ABC_TxStrStr(satoshi.c_str(), szQuery, pError))
+        // Live transactions the metadata walk cannot reach,
+        // either because their metadata is missing or lacks a txid,
+        // or because the transaction was malleated, go in directly.
+        // Their metadata, if any, comes from the ntxid,
+        // as in `ABC_TxGetTransactions`:
+        for (const auto &txid: self.cache.addresses.txidsUnnamed())
         {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
-        }
-        if (ABC_TxStrStr(currency.c_str(), szQuery, pError))
-        {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
+            TxInfo info;
+            TxStatus status;
+            if (!self.cache.txs.info(info, txid) ||
+                    !self.cache.txs.status(status, txid))
+                continue;
+
+            TxMeta meta;
+            const auto time = self.txs.get(meta, info.ntxid) ?
+                              txTime(self, status, &meta) :
+                              txTime(self, status, nullptr);
+            if (!allTimes && (time < startTime || endTime <= time))
+                continue;
+
+            best.insert(std::make_pair(time, txid));
+            if (wanted < best.size())
+                best.erase(std::prev(best.end()));
         }
-        if (ABC_TxStrStr(pInfo->pDetails->szName, szQuery, pError))
+
+        // Everything else has metadata naming its live txid:
+        TxMeta meta, newer;
+        bool first = true;
+        while (self.txs.older(meta, first ? nullptr : &newer))
         {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
+            first = false;
+            newer = meta;
+
+            // The metadata time is an upper bound on the real time:
+            if (!allTimes && meta.timeCreation < startTime)
+                break;
+            if (wanted <= best.size() && meta.timeCreation < best.rbegin()->first)
+                break;
+
+            // Stale rows for dropped transactions name dead txids:
+            TxStatus status;
+            if (!self.cache.addresses.txidKnown(meta.txid) ||
+                    !self.cache.txs.status(status, meta.txid))
+                continue;
+
+            const auto time = txTime(self, status, &meta);
+            if (!allTimes && (time < startTime || endTime <= time))
+                continue;
+
+            best.insert(std::make_pair(time, meta.txid));
+            if (wanted < best.size())
+                best.erase(std::prev(best.end()));
         }
-        else if (ABC_TxStrStr(pInfo->pDetails->szCategory, szQuery, pError))
+    }
+
+    if (offset < best.size())
+    {
+        ABC_ARRAY_NEW(aTransactions, best.size() - offset, tABC_TxInfo *);
+
+        auto i = best.begin();
+        std::advance(i, offset);
+        for (; best.end() != i; ++i)
         {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
+            TxInfo info;
+            TxStatus status;
+            if (self.cache.txs.info(info, i->second) &&
+                    self.cache.txs.status(status, i->second))
+                aTransactions[count++] = makeTxInfo(self, info, status);
         }
-        else if (ABC_TxStrStr(pInfo->pDetails->szNotes, szQuery, pError))
+    }
+
+    *paTransactions = aTransactions;
+    aTransactions = NULL;
+    *pCount = count;
+    count = 0;
+
+exit:
+    ABC_TxFreeTransactions(aTransactions, count);
+    return cc;
+}
+
+/**
+ * Searches transactions associated with the given wallet.
+ *
+ * @param szQuery           Query to search
+ * @param paTransactions    Pointer to store array of transactions info pointers
+ * @param pCount            Pointer to store number of transactions
+ * @param pError            A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_TxSearchTransactions(Wallet &self,
+                                 const char *szQuery,
+                                 tABC_TxInfo ***paTransactions,
+                                 unsigned int *pCount,
+                                 tABC_Error *pError)
+{
+    tABC_CC cc = ABC_CC_Ok;
+    tABC_TxInfo **aSearchTransactions = NULL;
+    std::vector<tABC_TxInfo *> found;
+
+    ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
+    ABC_CHECK_NULL(paTransactions);
+    *paTransactions = NULL;
+    ABC_CHECK_NULL(pCount);
+    *pCount = 0;
+    ABC_CHECK_NULL(szQuery);
+
+    if (*szQuery)
+    {
+        // The metadata index covers the text and fiat amounts,
+        // so only the matches need to touch the cache:
+        const auto matches = self.txs.search(szQuery);
+        TxidSet txids;
+        for (const auto &ntxid: matches)
         {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
+            TxMeta meta;
+            if (self.txs.get(meta, ntxid) &&
+                    self.cache.addresses.txidKnown(meta.txid))
+                txids.insert(meta.txid);
         }
-        else
+
+        // Live transactions the metadata does not name,
+        // such as malleated ones, still match by ntxid:
+        if (!matches.empty())
         {
-            ABC_TxFreeTransaction(pInfo);
+            for (const auto &txid: self.cache.addresses.txidsUnnamed())
+            {
+                TxInfo info;
+                if (self.cache.txs.info(info, txid) &&
+                        matches.count(info.ntxid))
+                    txids.insert(txid);
+            }
         }
-        aTransactions[i] = NULL;
+
+        // The satoshi amounts come from the live balances:
+        for (const auto &txid: self.addresses.balanceSearch(szQuery))
+            if (self.cache.addresses.txidKnown(txid))
+                txids.insert(txid);
+
+        for (const auto &info: self.cache.txs.statuses(txids))
+            found.push_back(makeTxInfo(self, info.first, info.second));
     }
-    if (matchCount > 0)
+
+    // Sort by creation date, like ABC_TxGetTransactions:
+    std::stable_sort(found.begin(), found.end(),
+                     [](const tABC_TxInfo *a, const tABC_TxInfo *b)
+    {
+        return a->timeCreation < b->timeCreation;
+    });
+
+    if (found.size())
     {
-        ABC_ARRAY_RESIZE(aSearchTransactions, matchCount, tABC_TxInfo *);
+        ABC_ARRAY_NEW(aSearchTransactions, found.size(), tABC_TxInfo *);
+        std::copy(found.begin(), found.end(), aSearchTransactions);
     }
 
     *paTransactions = aSearchTransactions;
-    *pCount = matchCount;
-    aTransactions = NULL;
+    *pCount = found.size();
+    found.clear();
+
 exit:
-    ABC_FREE(aTransactions);
+    for (auto pInfo: found)
+        ABC_TxFreeTransaction(pInfo);
     return cc;
 }
 
@@ -312,106 +489,4 @@ void ABC_TxFreeOutputs(tABC_TxOutput **aOutputs, unsigned int count)
     }
 }
 
-/**
- * This implemens the KMP failure function. Its the preprocessing before we can
- * search for substrings.
- *
- * @param needle - The string to preprocess
- * @param table - An array of integers the string length of needle
- *
- * Returns 1 if a match is found otherwise returns 0
- *
- */
-static
-void ABC_TxStrTable(const char *needle, int *table)
-{
-    size_t pos = 2, cnd = 0;
-    table[0] = -1;
-    table[1] = 0;
-    size_t needle_size = strlen(needle);
-
-    while (pos < needle_size)
-    {
-        if (tolower(needle[pos - 1]) == tolower(needle[cnd]))
-        {
-            cnd = cnd + 1;
-            table[pos] = cnd;
-            pos = pos + 1;
-        }
-        else if (cnd > 0)
-            cnd = table[cnd];
-        else
-        {
-            table[pos] = 0;
-            pos = pos + 1;
-        }
-    }
-}
-
-/**
- * This function implemens the KMP string searching algo. This function is
- * used for string matching when searching transactions.
- *
- * @param haystack - The string to search
- * @param needle - The string to find in the haystack
- *
- * Returns 1 if a match is found otherwise returns 0
- *
- */
-static
-int ABC_TxStrStr(const char *haystack, const char *needle,
-                 tABC_Error *pError)
-{
-    tABC_CC cc = ABC_CC_Ok;
-    if (haystack == NULL || needle == NULL)
-    {
-        return 0;
-    }
-    int result = -1;
-    size_t haystack_size;
-    size_t needle_size;
-    size_t m = 0, i = 0;
-    int *table;
-
-    haystack_size = strlen(haystack);
-    needle_size = strlen(needle);
-
-    if (haystack_size == 0 || needle_size == 0)
-    {
-        return 0;
-    }
-
-    ABC_ARRAY_NEW(table, needle_size, int);
-    ABC_TxStrTable(needle, table);
-
-    while (m + i < haystack_size)
-    {
-        if (tolower(needle[i]) == tolower(haystack[m + i]))
-        {
-            if (i == needle_size - 1)
-            {
-                result = m;
-                break;
-            }
-            i = i + 1;
-        }
-        else
-        {
-            if (table[i] > -1)
-            {
-                i = table[i];
-                m = m + i - table[i];
-            }
-            else
-            {
-                i = 0;
-                m = m + 1;
-            }
-        }
-    }
-exit:
-    ABC_FREE(table);
-    return result > -1 ? 1 : 0;
-}
-
 } // namespace abcd
@@ -9,6 +9,7 @@
 #define SRC_TX_INFO_HPP
 
 #include "../abcd/util/Status.hpp"
+#include <functional>
 
 namespace abcd {
 
@@ -23,6 +24,18 @@ class Wallet;
 tABC_TxInfo *
 makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status);
 
+typedef std::function<Status (const tABC_TxInfo &tx)> TxInfoVisitor;
+
+/**
+ * Visits the wallet's transactions in creation order,
+ * building each `tABC_TxInfo` structure only while it is in use.
+ * @param startTime, endTime The time range to visit,
+ * or ABC_GET_TX_ALL_TIMES for everything.
+ */
+Status
+forEachTxInfo(Wallet &self, int64_t startTime, int64_t endTime,
+              const TxInfoVisitor &visitor);
+
 tABC_CC ABC_TxGetTransactions(Wallet &self,
                               int64_t startTime,
                               int64_t endTime,
@@ -30,6 +43,15 @@ tABC_CC ABC_TxGetTransactions(Wallet &self,
                               unsigned int *pCount,
                               tABC_Error *pError);
 
+tABC_CC ABC_TxGetTransactionsPage(Wallet &self,
+                                  int64_t startTime,
+                                  int64_t endTime,
+                                  unsigned int offset,
+                                  unsigned int limit,
+                                  tABC_TxInfo ***paTransactions,
+                                  unsigned int *pCount,
+                                  tABC_Error *pError);
+
 tABC_CC ABC_TxSearchTransactions(Wallet &self,
                                  const char *szQuery,
                                  tABC_TxInfo ***paTransactions,
@@ -6,9 +6,15 @@
  */
 
 #include "../abcd/bitcoin/cache/BlockCache.hpp"
+#include "../abcd/bitcoin/cache/Cache.hpp"
 #include "../abcd/bitcoin/cache/TxCache.hpp"
+#include "../abcd/bitcoin/cache/TxLog.hpp"
 #include "../abcd/bitcoin/Utility.hpp"
 #include "../abcd/bitcoin/spend/Outputs.hpp"
+#include "../abcd/crypto/Encoding.hpp"
+#include "../abcd/json/JsonArray.hpp"
+#include "../abcd/json/JsonObject.hpp"
+#include "../abcd/util/FileIO.hpp"
 #include "../minilibs/catch/catch.hpp"
 
 namespace abcd {
@@ -181,12 +187,51 @@ hasTxid(const bc::output_info_list &utxos, bc::hash_digest txid, uint32_t index)
     return utxos.end() != std::find_if(utxos.begin(), utxos.end(), pred);
 }
 
+/**
+ * Picks a scratch file name, removing anything left by an earlier run.
+ */
+static std::string
+scratchPath(const std::string &name)
+{
+    const auto path = "test-" + name;
+    abcd::fileDelete(path).log();
+    abcd::fileDelete(path + ".tmp").log();
+    return path;
+}
+
+/**
+ * Replays a log into a readable list of records.
+ */
+static abcd::Status
+logRecords(std::vector<std::string> &result, abcd::TxLog &log)
+{
+    result.clear();
+    auto onTx = [&result](const bc::hash_digest &txid, abcd::DataSlice rawTx)
+    {
+        result.push_back("tx " + bc::encode_hash(txid) + " " +
+                         abcd::base16Encode(rawTx));
+    };
+    auto onHeight = [&result](const bc::hash_digest &txid,
+                              size_t height, time_t firstSeen)
+    {
+        result.push_back("height " + bc::encode_hash(txid) + " " +
+                         std::to_string(height) + " " +
+                         std::to_string(firstSeen));
+    };
+    auto onDrop = [&result](const bc::hash_digest &txid)
+    {
+        result.push_back("drop " + bc::encode_hash(txid));
+    };
+    return log.load(onTx, onHeight, onDrop);
+}
+
 TEST_CASE("Transaction database", "[bitcoin][database]")
 {
     abcd::BlockCache blockCache("");
     abcd::TxCache txCache(blockCache);
     abcd::TxCacheTest test(txCache);
     const auto rawUtxos = txCache.utxos(test.ourAddresses);
+    REQUIRE(txCache.checkUtxoIndex());
 
     SECTION("filtered utxos")
     {
@@ -209,3 +254,314 @@ TEST_CASE("Transaction database", "[bitcoin][database]")
         REQUIRE(!hasTxid(utxos, test.badSpendId, 0));
     }
 }
+
+TEST_CASE("Transaction status updates", "[bitcoin][database]")
+{
+    abcd::BlockCache blockCache("");
+    abcd::TxCache txCache(blockCache);
+    abcd::TxCacheTest test(txCache);
+    const auto badSpendTxid = bc::encode_hash(test.badSpendId);
+
+    abcd::TxStatus status;
+    REQUIRE(txCache.status(status, badSpendTxid));
+    REQUIRE(status.isDoubleSpent);
+
+    // Dropping the double-spend should clear its descendants:
+    REQUIRE(txCache.drop(bc::encode_hash(test.doubleSpendId), 2*60*60));
+    REQUIRE(txCache.status(status, badSpendTxid));
+    REQUIRE(!status.isDoubleSpent);
+    REQUIRE(txCache.checkUtxoIndex());
+
+    // Dropping the spend should restore the outputs it used:
+    REQUIRE(txCache.drop(badSpendTxid, 2*60*60));
+    REQUIRE(txCache.checkUtxoIndex());
+    const auto utxos = filterOutputs(txCache.utxos(test.ourAddresses), false);
+    REQUIRE(hasTxid(utxos, test.changeId, 0));
+
+    // Confirming the transaction should clear its remembered flags:
+    const auto irrelevantTxid = bc::encode_hash(test.irrelevantId);
+    REQUIRE(txCache.status(status, irrelevantTxid));
+    REQUIRE(status.isReplaceByFee);
+    txCache.confirmed(irrelevantTxid, 200);
+    REQUIRE(txCache.status(status, irrelevantTxid));
+    REQUIRE(!status.isReplaceByFee);
+}
+
+TEST_CASE("Transaction info updates", "[bitcoin][database]")
+{
+    abcd::BlockCache blockCache("");
+    abcd::TxCache txCache(blockCache);
+    abcd::TxCacheTest test(txCache);
+    const auto badSpendTxid = bc::encode_hash(test.badSpendId);
+
+    abcd::TxInfo info;
+    REQUIRE(txCache.info(info, badSpendTxid));
+    REQUIRE(txCache.info(info, badSpendTxid));
+
+    // Dropping a parent should forget the remembered info:
+    REQUIRE(txCache.drop(bc::encode_hash(test.doubleSpendId), 2*60*60));
+    REQUIRE(!txCache.info(info, badSpendTxid));
+    REQUIRE(1 == txCache.statuses({bc::encode_hash(test.changeId)}).size());
+}
+
+TEST_CASE("Transaction log", "[bitcoin][database]")
+{
+    const auto path = scratchPath("TxLog.bin");
+    const bc::hash_digest txidA{{0xaa}};
+    const bc::hash_digest txidB{{0xbb}};
+    const auto hexA = bc::encode_hash(txidA);
+    const auto hexB = bc::encode_hash(txidB);
+    const std::vector<std::string> expected
+    {
+        "tx " + hexA + " 010203",
+        "height " + hexA + " 100 1234",
+        "tx " + hexB + " 0405",
+        "drop " + hexB
+    };
+
+    {
+        abcd::TxLog log(path);
+        std::vector<std::string> records;
+        REQUIRE(!logRecords(records, log));
+
+        log.appendTx(txidA, abcd::DataChunk{1, 2, 3});
+        log.appendHeight(txidA, 100, 1234);
+        log.appendTx(txidB, abcd::DataChunk{4, 5});
+        log.appendDrop(txidB);
+        REQUIRE(log.write(log.detach()));
+    }
+
+    abcd::DataChunk original;
+    REQUIRE(abcd::fileLoad(original, path));
+
+    SECTION("round trip")
+    {
+        abcd::TxLog log(path);
+        std::vector<std::string> records;
+        REQUIRE(logRecords(records, log));
+        REQUIRE(expected == records);
+        REQUIRE(!log.stale(1));
+    }
+
+    SECTION("truncated record")
+    {
+        abcd::DataChunk truncated(original.begin(), original.end() - 1);
+        REQUIRE(abcd::fileSave(truncated, path));
+
+        // The complete records survive, but the file needs a rewrite:
+        abcd::TxLog log(path);
+        std::vector<std::string> records;
+        REQUIRE(logRecords(records, log));
+        REQUIRE(std::vector<std::string>(expected.begin(), expected.end() - 1)
+                == records);
+        REQUIRE(log.stale(1));
+        REQUIRE(log.detach().rewrite);
+    }
+
+    SECTION("append")
+    {
+        abcd::TxLog log(path);
+        std::vector<std::string> records;
+        REQUIRE(logRecords(records, log));
+
+        log.appendHeight(txidA, 200, 1234);
+        const auto batch = log.detach();
+        REQUIRE(!batch.rewrite);
+        REQUIRE(log.write(batch));
+
+        // The old bytes stay put, with the new record after them:
+        abcd::DataChunk appended;
+        REQUIRE(abcd::fileLoad(appended, path));
+        REQUIRE((original.size() + batch.data.size()) == appended.size());
+        REQUIRE(std::equal(original.begin(), original.end(), appended.begin()));
+
+        abcd::TxLog reload(path);
+        REQUIRE(logRecords(records, reload));
+        REQUIRE((expected.size() + 1) == records.size());
+        REQUIRE(("height " + hexA + " 200 1234") == records.back());
+    }
+
+    SECTION("rewrite")
+    {
+        abcd::TxLog log(path);
+        std::vector<std::string> records;
+        REQUIRE(logRecords(records, log));
+
+        log.rewrite();
+        log.appendTx(txidA, abcd::DataChunk{1, 2, 3});
+        const auto batch = log.detach();
+        REQUIRE(batch.rewrite);
+        REQUIRE(log.write(batch));
+
+        abcd::TxLog reload(path);
+        REQUIRE(logRecords(records, reload));
+        REQUIRE(std::vector<std::string>{expected.front()} == records);
+    }
+
+    abcd::fileDelete(path).log();
+}
+
+TEST_CASE("Transaction cache migration", "[bitcoin][database]")
+{
+    const auto cachePath = scratchPath("Cache.json");
+    const auto txsPath = scratchPath("Txs.bin");
+    const auto serversPath = scratchPath("Servers.json");
+
+    bc::transaction_type tx
+    {
+        0, 0,
+        {
+            {{bc::null_hash, 0}, {}, 0xffffffff}
+        },
+        {
+            {1, {}}
+        }
+    };
+    const auto txid = bc::encode_hash(bc::hash_transaction(tx));
+    bc::data_chunk rawTx(satoshi_raw_size(tx));
+    bc::satoshi_save(tx, rawTx.begin());
+
+    // Write a cache in the old format:
+    {
+        abcd::JsonObject txJson;
+        REQUIRE(txJson.set("txid", txid));
+        REQUIRE(txJson.set("data", abcd::base64Encode(rawTx)));
+        abcd::JsonArray txsJson;
+        REQUIRE(txsJson.append(txJson));
+
+        abcd::JsonObject heightJson;
+        REQUIRE(heightJson.set("txid", txid));
+        REQUIRE(heightJson.set("height", json_int_t(100)));
+        REQUIRE(heightJson.set("firstSeen", json_int_t(1234)));
+        abcd::JsonArray heightsJson;
+        REQUIRE(heightsJson.append(heightJson));
+
+        abcd::JsonObject cacheJson;
+        REQUIRE(cacheJson.set("txs", txsJson));
+        REQUIRE(cacheJson.set("heights", heightsJson));
+        REQUIRE(cacheJson.save(cachePath));
+    }
+
+    // The missing binary file sends the load through the JSON:
+    abcd::BlockCache blockCache("");
+    abcd::ServerCache serverCache(serversPath);
+    {
+        abcd::Cache cache(cachePath, txsPath, blockCache, serverCache);
+        REQUIRE(cache.load());
+
+        bc::transaction_type result;
+        REQUIRE(cache.txs.get(result, txid));
+        REQUIRE(cache.save());
+    }
+
+    // Now the binary file has everything:
+    abcd::TxCache txCache(blockCache, txsPath);
+    REQUIRE(txCache.load());
+    bc::transaction_type result;
+    REQUIRE(txCache.get(result, txid));
+    REQUIRE(txid == bc::encode_hash(bc::hash_transaction(result)));
+    abcd::TxStatus status;
+    REQUIRE(txCache.status(status, txid));
+    REQUIRE(100 == status.height);
+
+    abcd::fileDelete(cachePath).log();
+    abcd::fileDelete(txsPath).log();
+    abcd::fileDelete(serversPath).log();
+}
+
+TEST_CASE("Transaction cache file mapping", "[bitcoin][database]")
+{
+    const auto path = scratchPath("TxCache.bin");
+    const size_t count = 1100; // Enough to overflow the decoded list
+
+    bc::script_type script;
+    abcd::outputScriptForAddress(script, "1QLbz7JHiBTspS962RLKV8GndWFwi5j6Qr");
+
+    // One parent with an output for each child:
+    bc::transaction_type root
+    {
+        0, 0,
+        {
+            {{bc::null_hash, 0}, {}, 0xffffffff}
+        },
+        {}
+    };
+    for (size_t i = 0; i < count; ++i)
+        root.outputs.push_back({1000, script});
+    const auto rootId = bc::hash_transaction(root);
+
+    std::vector<bc::hash_digest> childIds;
+    abcd::BlockCache blockCache("");
+    {
+        abcd::TxCache txCache(blockCache, path);
+        txCache.insert(root);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            bc::transaction_type child
+            {
+                0, 0,
+                {
+                    {{rootId, i}, {}, 0xffffffff}
+                },
+                {
+                    {900, script}
+                }
+            };
+            childIds.push_back(bc::hash_transaction(child));
+            txCache.insert(child);
+            if (0 == i % 2)
+                txCache.confirmed(bc::encode_hash(childIds.back()), i + 1);
+        }
+        REQUIRE(txCache.save());
+
+        // Leave a disposable record at the end of the file:
+        txCache.confirmed(bc::encode_hash(bc::null_hash), 1);
+        REQUIRE(txCache.save());
+    }
+
+    const auto check = [&](const abcd::TxCache &txCache)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto txid = bc::encode_hash(childIds[i]);
+
+            bc::transaction_type tx;
+            REQUIRE(txCache.get(tx, txid));
+            REQUIRE(childIds[i] == bc::hash_transaction(tx));
+
+            abcd::TxInfo info;
+            REQUIRE(txCache.info(info, txid));
+            REQUIRE(txid == info.txid);
+            REQUIRE(100 == info.fee);
+
+            abcd::TxStatus status;
+            REQUIRE(txCache.status(status, txid));
+            REQUIRE((i % 2 ? 0 : i + 1) == status.height);
+        }
+    };
+
+    // Damage the last record, so the next save rewrites the file:
+    abcd::DataChunk data;
+    REQUIRE(abcd::fileLoad(data, path));
+    data.pop_back();
+    REQUIRE(abcd::fileSave(data, path));
+
+    abcd::TxCache txCache(blockCache, path);
+    REQUIRE(txCache.load());
+    check(txCache);
+
+    // The early transactions have been evicted by now:
+    check(txCache);
+    REQUIRE(txCache.checkUtxoIndex());
+
+    // The rewrite replaces the file, but not the existing mapping:
+    REQUIRE(txCache.save());
+    check(txCache);
+
+    // Loading again maps the rewritten file:
+    REQUIRE(txCache.load());
+    check(txCache);
+    REQUIRE(txCache.checkUtxoIndex());
+
+    abcd::fileDelete(path).log();
+}
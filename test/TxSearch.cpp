@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/wallet/TxSearch.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Transaction metadata search", "[wallet][search]" )
+{
+    abcd::TxSearch search;
+    search.insert("a", {"Coffee Shop", "Expense:Food", "", "3.500000"});
+    search.insert("b", {"Paycheck", "Income:Salary", "March", "1500.000000"});
+
+    SECTION("substrings ignore case")
+    {
+        REQUIRE((search.find("COFFEE") == std::set<std::string>{"a"}));
+        REQUIRE((search.find("e:") == std::set<std::string>{"a", "b"}));
+        REQUIRE((search.find("500") == std::set<std::string>{"a", "b"}));
+        REQUIRE(search.find("").empty());
+    }
+
+    SECTION("grams must appear in order")
+    {
+        REQUIRE(search.find("shopcoffee").empty());
+    }
+
+    SECTION("matches stay within a field")
+    {
+        REQUIRE(search.find("shopexpense").empty());
+        REQUIRE(search.find("food3").empty());
+    }
+
+    SECTION("entries can change")
+    {
+        search.insert("a", {"Tea House", "", "", "0.000000"});
+        REQUIRE(search.find("coffee").empty());
+        REQUIRE((search.find("tea") == std::set<std::string>{"a"}));
+
+        search.erase("b");
+        REQUIRE(search.find("paycheck").empty());
+    }
+}